@@ -0,0 +1,425 @@
+#include "../include/json.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <sys/stat.h>
+
+using namespace badge881::json;
+
+// every allocation of the process is counted, the library's included.
+// kept out of line so g++ pairs new with delete at the call sites instead
+// of seeing malloc and free, which -Wmismatched-new-delete would flag
+namespace
+{
+    std::atomic<size_t> allocations{0};
+}
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    // the corpus is generated from fixed seeds, the same files on every machine
+    class generator
+    {
+        uint64_t state;
+
+    public:
+        explicit generator(uint64_t seed) : state(seed) {}
+
+        uint64_t next()
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717ull;
+        }
+
+        uint64_t below(uint64_t bound)
+        {
+            return next() % bound;
+        }
+    };
+
+    void appendNumber(std::string &out, double value)
+    {
+        char digits[32];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    void appendInteger(std::string &out, long long value)
+    {
+        char digits[32];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    std::string numbers()
+    {
+        generator g(1);
+        std::string out = "[";
+        for (int i = 0; i < 300000; ++i)
+        {
+            if (i)
+                out += ',';
+            if (g.below(2))
+                appendInteger(out, (long long)g.below(2000000000) - 1000000000);
+            else
+                appendNumber(out, double((long long)g.below(2000000000) - 1000000000) / double(1 + g.below(100000)));
+        }
+        return out + "]";
+    }
+
+    std::string text(generator &g, size_t length)
+    {
+        static const char *pieces[] = {"\\\"", "\\\\", "\\n", "\\u00e9", "\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", " "};
+        std::string out;
+        while (out.size() < length)
+            if (g.below(16) == 0)
+                out += pieces[g.below(7)];
+            else
+                out += char('a' + g.below(26));
+        return out;
+    }
+
+    std::string strings()
+    {
+        generator g(2);
+        std::string out = "[";
+        for (int i = 0; i < 60000; ++i)
+        {
+            if (i)
+                out += ',';
+            out += '"' + text(g, 10 + g.below(110)) + '"';
+        }
+        return out + "]";
+    }
+
+    std::string nested()
+    {
+        generator g(3);
+        std::string out = "[";
+        for (int i = 0; i < 2000; ++i)
+        {
+            if (i)
+                out += ',';
+            std::string closing;
+            for (int depth = 0; depth < 64; ++depth)
+                if (depth % 2)
+                {
+                    out += "[" + std::to_string(g.below(100)) + ",";
+                    closing = "]" + closing;
+                }
+                else
+                {
+                    out += "{\"k" + std::to_string(depth) + "\":true,\"next\":";
+                    closing = "}" + closing;
+                }
+            out += "null" + closing;
+        }
+        return out + "]";
+    }
+
+    std::string wide()
+    {
+        generator g(4);
+        std::string out = "{";
+        for (int i = 0; i < 100000; ++i)
+        {
+            if (i)
+                out += ',';
+            out += "\"key_" + std::to_string(i) + "\":";
+            switch (g.below(3))
+            {
+            case 0:
+                appendInteger(out, (long long)g.below(1000000));
+                break;
+            case 1:
+                out += '"' + text(g, 4 + g.below(12)) + '"';
+                break;
+            default:
+                out += g.below(2) ? "true" : "false";
+            }
+        }
+        return out + "}";
+    }
+
+    std::string records()
+    {
+        generator g(5);
+        std::string out;
+        for (int i = 0; i < 50000; ++i)
+        {
+            out += "{\"id\":" + std::to_string(i) + ",\"name\":\"" + text(g, 6 + g.below(10)) + "\",\"score\":";
+            appendNumber(out, double(g.below(1000000)) / 100.0);
+            out += std::string(",\"active\":") + (g.below(2) ? "true" : "false") + ",\"tags\":[";
+            for (uint64_t t = 0, count = g.below(5); t < count; ++t)
+                out += (t ? ",\"" : "\"") + text(g, 3 + g.below(5)) + '"';
+            out += "],\"nested\":{\"x\":" + std::to_string(g.below(100)) + ",\"y\":null,\"z\":[1,2,3]}}\n";
+        }
+        return out;
+    }
+
+    struct corpus_file
+    {
+        const char *name;
+        std::string (*make)();
+        bool lines;
+    };
+
+    const corpus_file corpus[] = {
+        {"numbers.json", numbers, false},
+        {"strings.json", strings, false},
+        {"nested.json", nested, false},
+        {"wide.json", wide, false},
+        {"records.ndjson", records, true},
+    };
+
+    std::string readAll(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream buffer;
+        buffer << in.rdbuf();
+        return buffer.str();
+    }
+
+    bool exists(const std::string &path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0;
+    }
+
+    using clock_type = std::chrono::steady_clock;
+
+    double since(clock_type::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    }
+
+    struct measurement
+    {
+        double nanoseconds;
+        size_t allocations;
+    };
+
+    // the operation returns the nanoseconds it wants counted, so that setup
+    // such as parsing the document to destroy stays out. runs at least three
+    // times and for a quarter of a second, the median is kept
+    template <typename operationT>
+    measurement measure(operationT &&operation)
+    {
+        operation();
+        std::vector<double> runs;
+        size_t allocated = 0;
+        double total = 0;
+        while (runs.size() < 3 || (total < 2.5e8 && runs.size() < 50))
+        {
+            size_t before = allocations.load();
+            runs.push_back(operation());
+            allocated = allocations.load() - before;
+            total += runs.back();
+        }
+        std::sort(runs.begin(), runs.end());
+        return {runs[runs.size() / 2], allocated};
+    }
+
+    struct result
+    {
+        std::string file;
+        std::string operation;
+        size_t bytes;
+        size_t documents;
+        measurement m;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    std::string directory = argc > 1 ? argv[1] : "bench/corpus";
+    std::string output = argc > 2 ? argv[2] : "bench/results.json";
+#ifdef _WIN32
+    mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+
+    std::vector<result> results;
+    for (const corpus_file &file : corpus)
+    {
+        std::string path = directory + "/" + file.name;
+        if (!exists(path))
+        {
+            std::ofstream(path, std::ios::binary) << file.make();
+        }
+        const std::string input = readAll(path);
+        std::string copyPath = path + ".out";
+        std::vector<line_error> errors;
+
+        // one document, or one per line for newline delimited json
+        auto load = [&]
+        {
+            if (file.lines)
+                return parseLines(input, errors);
+            return std::vector<json>{parse(input)};
+        };
+        const std::vector<json> documents = load();
+        const std::vector<json> others = load();
+        size_t count = documents.size();
+        auto add = [&](const char *operation, measurement m)
+        {
+            results.push_back({file.name, operation, input.size(), count, m});
+        };
+
+        add("parse", measure([&]
+                             {
+                                 auto start = clock_type::now();
+                                 std::vector<json> parsed = load();
+                                 double elapsed = since(start);
+                                 return elapsed; }));
+        add("parseFile", measure([&]
+                                 {
+                                     auto start = clock_type::now();
+                                     if (file.lines)
+                                         parseLinesFile(path, errors);
+                                     else
+                                         parseFile(path);
+                                     return since(start); }));
+        add("print", measure([&]
+                             {
+                                 auto start = clock_type::now();
+                                 for (const json &document : documents)
+                                     print(document);
+                                 return since(start); }));
+        add("printFile", measure([&]
+                                 {
+                                     auto start = clock_type::now();
+                                     if (file.lines)
+                                     {
+                                         // one line per document into a single file
+                                         std::FILE *out = std::fopen(copyPath.c_str(), "wb");
+                                         for (const json &document : documents)
+                                         {
+                                             print(document, out);
+                                             std::fputc('\n', out);
+                                         }
+                                         std::fclose(out);
+                                     }
+                                     else
+                                         printFile(documents.front(), copyPath);
+                                     return since(start); }));
+        // two trees parsed apart, equal without sharing a single payload
+        add("operator==", measure([&]
+                                  {
+                                      auto start = clock_type::now();
+                                      size_t equal = 0;
+                                      for (size_t i = 0; i < count; ++i)
+                                          equal += documents[i] == others[i];
+                                      if (equal != count)
+                                          std::abort();
+                                      return since(start); }));
+        add("hash", measure([&]
+                            {
+                                auto start = clock_type::now();
+                                size_t combined = 0;
+                                for (const json &document : documents)
+                                    combined ^= std::hash<json>()(document);
+                                volatile size_t sink = combined;
+                                (void)sink;
+                                return since(start); }));
+        // a copy only takes a reference to the shared payload
+        add("copy", measure([&]
+                            {
+                                auto start = clock_type::now();
+                                std::vector<json> copies(documents);
+                                double elapsed = since(start);
+                                return elapsed; }));
+        add("destroy", measure([&]
+                               {
+                                   std::vector<json> *doomed = new std::vector<json>(load());
+                                   auto start = clock_type::now();
+                                   delete doomed;
+                                   return since(start); }));
+        // the same documents in the binary formats, bytes is their encoded size
+        for (binary_format format : {binary_format::cbor, binary_format::messagePack})
+        {
+            bool cbor = format == binary_format::cbor;
+            std::vector<std::string> encoded;
+            size_t bytes = 0;
+            for (const json &document : documents)
+            {
+                encoded.push_back(encode(document, format));
+                bytes += encoded.back().size();
+            }
+            auto addEncoded = [&](const char *operation, measurement m)
+            {
+                results.push_back({file.name, operation, bytes, count, m});
+            };
+            addEncoded(cbor ? "encodeCbor" : "encodeMsgPack", measure([&]
+                                                                      {
+                                                                          auto start = clock_type::now();
+                                                                          for (const json &document : documents)
+                                                                              encode(document, format);
+                                                                          return since(start); }));
+            addEncoded(cbor ? "decodeCbor" : "decodeMsgPack", measure([&]
+                                                                      {
+                                                                          auto start = clock_type::now();
+                                                                          for (const std::string &e : encoded)
+                                                                              decode(e, format);
+                                                                          return since(start); }));
+        }
+        std::remove(copyPath.c_str());
+    }
+
+    std::printf("%-16s %-13s %10s %10s %14s %14s\n", "file", "operation", "bytes", "MB/s", "ns/doc", "allocs/doc");
+    json rows = json(collection{});
+    for (const result &r : results)
+    {
+        double seconds = r.m.nanoseconds / 1e9;
+        double megabytes = double(r.bytes) / (1024.0 * 1024.0);
+        double perDocument = r.m.nanoseconds / double(r.documents);
+        double allocationsPerDocument = double(r.m.allocations) / double(r.documents);
+        std::printf("%-16s %-13s %10zu %10.1f %14.0f %14.1f\n", r.file.c_str(), r.operation.c_str(), r.bytes, megabytes / seconds, perDocument, allocationsPerDocument);
+        rows.get<std::vector<json>>().push_back(json(object{
+            {"file", json(r.file)},
+            {"operation", json(r.operation)},
+            {"bytes", json((unsigned long long)r.bytes)},
+            {"documents", json((unsigned long long)r.documents)},
+            {"mb_per_s", json(megabytes / seconds)},
+            {"ns_per_doc", json(perDocument)},
+            {"allocations_per_doc", json(allocationsPerDocument)},
+        }));
+    }
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    json report = json(object{
+        {"date", json(std::string(date))},
+        {"compiler", json(std::string(__VERSION__))},
+        {"results", rows},
+    });
+    print_options options;
+    options.indent = 2;
+    printFile(report, output, options);
+    std::printf("results written to %s\n", output.c_str());
+}
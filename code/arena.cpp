@@ -0,0 +1,83 @@
+#include "../include/json.h"
+#include <new>
+
+namespace badge881::json
+{
+    struct arena::block
+    {
+        block *next;
+        size_t size;
+    };
+
+    arena::arena(size_t firstBlock) : nextSize(firstBlock < 1024 ? 1024 : firstBlock) {}
+
+    arena::~arena()
+    {
+        release();
+    }
+
+    void *arena::do_allocate(size_t bytes, size_t alignment)
+    {
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+        if (padding + bytes > left)
+        {
+            // blocks double in size so a document needs only a handful
+            size_t size = nextSize;
+            while (size < bytes + alignment + sizeof(block))
+                size *= 2;
+            block *b = static_cast<block *>(::operator new(size));
+            b->next = blocks;
+            b->size = size;
+            blocks = b;
+            reserved += size;
+            nextSize = size * 2;
+            current = reinterpret_cast<char *>(b + 1);
+            left = size - sizeof(block);
+            padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+        }
+        char *result = current + padding;
+        current = result + bytes;
+        left -= padding + bytes;
+        return result;
+    }
+
+    void arena::do_deallocate(void *, size_t, size_t)
+    {
+        // memory only comes back all at once
+    }
+
+    bool arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    {
+        return this == &other;
+    }
+
+    void arena::release()
+    {
+        // a reused arena starts from its largest block instead of growing
+        // further, so once it has held a document one block fits the next
+        if (blocks)
+            nextSize = 0;
+        while (blocks)
+        {
+            block *next = blocks->next;
+            if (blocks->size > nextSize)
+                nextSize = blocks->size;
+            ::operator delete(blocks);
+            blocks = next;
+        }
+        current = nullptr;
+        left = 0;
+        reserved = 0;
+        kept.clear();
+    }
+
+    size_t arena::capacity() const
+    {
+        return reserved;
+    }
+
+    void arena::keepAlive(std::shared_ptr<const void> owner)
+    {
+        kept.push_back(std::move(owner));
+    }
+}
@@ -0,0 +1,790 @@
+#include "../include/json.h"
+#include "parser.h"
+#include "strings.h"
+#include "internals.h"
+#include "stats.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <memory_resource>
+
+namespace badge881::json
+{
+    namespace
+    {
+        // both formats write multi byte numbers big endian
+        void appendBig(std::string &out, uint64_t value, size_t bytes)
+        {
+            char b[8];
+            for (size_t i = bytes; i-- > 0; value >>= 8)
+                b[i] = char(value & 0xff);
+            out.append(b, bytes);
+        }
+
+        uint32_t floatBits(float f)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            return bits;
+        }
+
+        uint64_t doubleBits(double d)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            return bits;
+        }
+
+        double fromFloatBits(uint32_t bits)
+        {
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+
+        double fromDoubleBits(uint64_t bits)
+        {
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            return d;
+        }
+
+        // cbor half precision, only ever read
+        double fromHalfBits(uint16_t bits)
+        {
+            int exponent = (bits >> 10) & 0x1f;
+            int mantissa = bits & 0x3ff;
+            double value;
+            if (exponent == 0)
+                value = std::ldexp(mantissa, -24);
+            else if (exponent != 31)
+                value = std::ldexp(mantissa + 1024, exponent - 25);
+            else
+                value = mantissa ? std::numeric_limits<double>::quiet_NaN() : std::numeric_limits<double>::infinity();
+            return bits & 0x8000 ? -value : value;
+        }
+
+        // serializes a whole tree into one growing buffer, handed over to
+        // the stream every time it fills up when there is one
+        class encoder
+        {
+            std::string &buffer;
+            binary_format format;
+            std::ostream *sink = nullptr;
+
+            static constexpr size_t chunk = 1 << 16;
+
+            // cbor : the major type in the top three bits and the argument
+            // below them when under 24, otherwise in the next 1, 2, 4 or 8 bytes
+            void head(unsigned major, uint64_t argument)
+            {
+                char m = char(major << 5);
+                if (argument < 24)
+                    buffer += char(m | char(argument));
+                else if (argument <= 0xff)
+                {
+                    buffer += char(m | 24);
+                    appendBig(buffer, argument, 1);
+                }
+                else if (argument <= 0xffff)
+                {
+                    buffer += char(m | 25);
+                    appendBig(buffer, argument, 2);
+                }
+                else if (argument <= 0xffffffff)
+                {
+                    buffer += char(m | 26);
+                    appendBig(buffer, argument, 4);
+                }
+                else
+                {
+                    buffer += char(m | 27);
+                    appendBig(buffer, argument, 8);
+                }
+            }
+
+            // messagepack : sizes under fixLimit fit the fixed form, then the
+            // 8, 16 and 32 bit ones. arrays and maps have no 8 bit form
+            void packedSize(size_t size, unsigned char fixed, size_t fixLimit, unsigned char code8, unsigned char code16, unsigned char code32)
+            {
+                if (size < fixLimit)
+                    buffer += char(fixed | size);
+                else if (code8 && size <= 0xff)
+                {
+                    buffer += char(code8);
+                    appendBig(buffer, size, 1);
+                }
+                else if (size <= 0xffff)
+                {
+                    buffer += char(code16);
+                    appendBig(buffer, size, 2);
+                }
+                else if (size <= 0xffffffff)
+                {
+                    buffer += char(code32);
+                    appendBig(buffer, size, 4);
+                }
+                else
+                    throw json::write_error("messagepack cannot hold a string or container of more than 2^32 - 1 entries");
+            }
+
+            void signedInteger(long long value)
+            {
+                if (value >= 0)
+                    return unsignedInteger((unsigned long long)value);
+                if (format == binary_format::cbor)
+                    return head(1, uint64_t(-1 - value));
+                if (value >= -32)
+                    buffer += char(value);
+                else if (value >= -128)
+                {
+                    buffer += char(0xd0);
+                    appendBig(buffer, uint64_t(value), 1);
+                }
+                else if (value >= -32768)
+                {
+                    buffer += char(0xd1);
+                    appendBig(buffer, uint64_t(value), 2);
+                }
+                else if (value >= std::numeric_limits<int32_t>::min())
+                {
+                    buffer += char(0xd2);
+                    appendBig(buffer, uint64_t(value), 4);
+                }
+                else
+                {
+                    buffer += char(0xd3);
+                    appendBig(buffer, uint64_t(value), 8);
+                }
+            }
+
+            void unsignedInteger(unsigned long long value)
+            {
+                if (format == binary_format::cbor)
+                    return head(0, value);
+                if (value < 0x80)
+                    buffer += char(value);
+                else if (value <= 0xff)
+                {
+                    buffer += char(0xcc);
+                    appendBig(buffer, value, 1);
+                }
+                else if (value <= 0xffff)
+                {
+                    buffer += char(0xcd);
+                    appendBig(buffer, value, 2);
+                }
+                else if (value <= 0xffffffff)
+                {
+                    buffer += char(0xce);
+                    appendBig(buffer, value, 4);
+                }
+                else
+                {
+                    buffer += char(0xcf);
+                    appendBig(buffer, value, 8);
+                }
+            }
+
+            // single precision when it holds the value exactly
+            void real(double value)
+            {
+                float narrow = float(value);
+                bool exact = double(narrow) == value || std::isnan(value);
+                if (format == binary_format::cbor)
+                    buffer += char(exact ? 0xfa : 0xfb);
+                else
+                    buffer += char(exact ? 0xca : 0xcb);
+                if (exact)
+                    appendBig(buffer, floatBits(narrow), 4);
+                else
+                    appendBig(buffer, doubleBits(value), 8);
+            }
+
+            void number(const json &j)
+            {
+                if (!j.isInteger())
+                    real(j.get<double>());
+                else if (j.get<double>() < 0)
+                    signedInteger(j.get<long long>());
+                else
+                    unsignedInteger(j.get<unsigned long long>());
+            }
+
+            void string(std::string_view s)
+            {
+                if (format == binary_format::cbor)
+                    head(3, s.size());
+                else
+                    packedSize(s.size(), 0xa0, 32, 0xd9, 0xda, 0xdb);
+                buffer.append(s.data(), s.size());
+            }
+
+            void collection(size_t count)
+            {
+                if (format == binary_format::cbor)
+                    head(4, count);
+                else
+                    packedSize(count, 0x90, 16, 0, 0xdc, 0xdd);
+            }
+
+            void map(size_t count)
+            {
+                if (format == binary_format::cbor)
+                    head(5, count);
+                else
+                    packedSize(count, 0x80, 16, 0, 0xde, 0xdf);
+            }
+
+        public:
+            encoder(std::string &out, binary_format f) : buffer(out), format(f) {}
+
+            encoder(std::string &out, binary_format f, std::ostream &os) : buffer(out), format(f), sink(&os)
+            {
+                buffer.reserve(chunk + chunk / 4);
+            }
+
+            void flush()
+            {
+                if (sink && !buffer.empty())
+                {
+                    stats::wrote(buffer.size());
+                    sink->write(buffer.data(), std::streamsize(buffer.size()));
+                    buffer.clear();
+                }
+            }
+
+            // every container is written with its size up front, so there
+            // is nothing to close : the stack only keeps what is left of each
+            void write(const json &root)
+            {
+                struct frame
+                {
+                    bool object;
+                    member_cursor members;
+                    const json *elements;
+                    size_t left;
+                };
+                std::vector<frame> open;
+                const json *j = &root;
+                while (true)
+                {
+                    if (sink && buffer.size() >= chunk)
+                        flush();
+                    switch (j->getType())
+                    {
+                    case nullType:
+                        buffer += char(format == binary_format::cbor ? 0xf6 : 0xc0);
+                        break;
+                    case booleanType:
+                        if (format == binary_format::cbor)
+                            buffer += char(j->get<bool>() ? 0xf5 : 0xf4);
+                        else
+                            buffer += char(j->get<bool>() ? 0xc3 : 0xc2);
+                        break;
+                    case numberType:
+                        number(*j);
+                        break;
+                    case stringType:
+                        string(node_access::string(*j));
+                        break;
+                    case objectType:
+                    {
+                        size_t count = node_access::memberCount(*j);
+                        map(count);
+                        if (count)
+                            open.push_back(frame{true, node_access::members(*j), nullptr, count});
+                        break;
+                    }
+                    case collectionType:
+                    {
+                        auto [array, count] = node_access::elements(*j);
+                        collection(count);
+                        if (count)
+                            open.push_back(frame{false, member_cursor(), array, count});
+                        break;
+                    }
+                    }
+                    while (!open.empty() && open.back().left == 0)
+                        open.pop_back();
+                    if (open.empty())
+                        return;
+                    frame &f = open.back();
+                    --f.left;
+                    if (f.object)
+                    {
+                        string(f.members.key());
+                        j = &f.members.value();
+                        f.members.next();
+                    }
+                    else
+                        j = f.elements++;
+                }
+            }
+        };
+
+        // reads one value in a loop over a stack of the containers still
+        // open, like the text parser, and reports it to the handler
+        template <typename handler_type>
+        class decoder
+        {
+            struct frame
+            {
+                // entries still to come, pairs for a map
+                uint64_t left;
+                bool object;
+                // cbor containers of unknown size end with a break byte
+                bool indefinite;
+            };
+
+            const unsigned char *begin;
+            const unsigned char *current;
+            const unsigned char *end;
+            handler_type &handler;
+            binary_format format;
+            size_t maxDepth;
+            std::vector<frame> open;
+            // cbor strings sent in chunks are joined, see parser::decodingSpace
+            std::string scratch;
+            std::unique_ptr<std::pmr::monotonic_buffer_resource> keyText;
+            std::pmr::memory_resource *keep = nullptr;
+
+            [[noreturn]] void fail(const char *problem)
+            {
+                throw json::read_error(std::string(format == binary_format::cbor ? "invalid cbor input : " : "invalid messagepack input : ") + problem);
+            }
+
+            unsigned char next()
+            {
+                if (current == end)
+                    fail("unexpected end of input");
+                return *current++;
+            }
+
+            uint64_t big(size_t bytes)
+            {
+                if (size_t(end - current) < bytes)
+                    fail("unexpected end of input");
+                uint64_t value = 0;
+                for (size_t i = 0; i < bytes; ++i)
+                    value = value << 8 | current[i];
+                current += bytes;
+                return value;
+            }
+
+            // the bytes of a string that follow, left in place
+            std::string_view take(uint64_t size)
+            {
+                if (uint64_t(end - current) < size)
+                    fail("unexpected end of input");
+                std::string_view s(reinterpret_cast<const char *>(current), size_t(size));
+                current += size;
+                return s;
+            }
+
+            char *joiningSpace(size_t size, bool key)
+            {
+                if (keep)
+                {
+                    stats::allocated(size);
+                    return static_cast<char *>(keep->allocate(size ? size : 1, 1));
+                }
+                if (key)
+                {
+                    if (!keyText)
+                        keyText = std::make_unique<std::pmr::monotonic_buffer_resource>();
+                    return static_cast<char *>(keyText->allocate(size ? size : 1, 1));
+                }
+                scratch.resize(size);
+                return scratch.data();
+            }
+
+            void text(std::string_view s, bool key)
+            {
+                // most strings are short and ascii, cheaper to tell than to validate
+                unsigned char high = 0;
+                for (char c : s)
+                    high |= static_cast<unsigned char>(c);
+                if ((high & 0x80) && !isValidUtf8(s.data(), s.size()))
+                    fail("invalid utf-8 in string");
+                if (key)
+                    handler.onKey(s);
+                else
+                {
+                    stats::node(stringType);
+                    handler.onString(s);
+                }
+            }
+
+            void start(bool object, uint64_t count, bool indefinite)
+            {
+                if (open.size() == maxDepth)
+                    fail("nesting deeper than the maximum depth");
+                stats::node(object ? objectType : collectionType);
+                stats::enter();
+                open.push_back(frame{count, object, indefinite});
+                if (object)
+                    handler.onStartObject();
+                else
+                    handler.onStartArray();
+            }
+
+            void close()
+            {
+                bool object = open.back().object;
+                open.pop_back();
+                stats::leave();
+                if (object)
+                    handler.onEndObject();
+                else
+                    handler.onEndArray();
+            }
+
+            void integer(uint64_t value)
+            {
+                stats::node(numberType);
+                if (value <= uint64_t(std::numeric_limits<long long>::max()))
+                    handler.onInteger((long long)value);
+                else
+                    handler.onUnsigned(value);
+            }
+
+            void negative(long long value)
+            {
+                stats::node(numberType);
+                handler.onInteger(value);
+            }
+
+            void real(double value)
+            {
+                stats::node(numberType);
+                handler.onNumber(value);
+            }
+
+            // the argument of a cbor head, info 31 stands for an unknown size
+            uint64_t argument(unsigned info)
+            {
+                if (info < 24)
+                    return info;
+                if (info == 31)
+                    return UINT64_MAX;
+                if (info > 27)
+                    fail("reserved additional information");
+                return big(size_t(1) << (info - 24));
+            }
+
+            void cborString(unsigned info, bool key)
+            {
+                if (info != 31)
+                    return text(take(argument(info)), key);
+                // chunks of definite size until the break byte, measured
+                // first so the joined string is written once
+                const unsigned char *chunks = current;
+                uint64_t total = 0;
+                while (true)
+                {
+                    unsigned char initial = next();
+                    if (initial == 0xff)
+                        break;
+                    if (initial >> 5 != 3 || (initial & 31) == 31)
+                        fail("text string chunk expected");
+                    uint64_t size = take(argument(initial & 31)).size();
+                    total += size;
+                }
+                const unsigned char *after = current;
+                char *out = joiningSpace(size_t(total), key);
+                char *p = out;
+                current = chunks;
+                while (current != after - 1)
+                {
+                    std::string_view piece = take(argument(next() & 31));
+                    std::memcpy(p, piece.data(), piece.size());
+                    p += piece.size();
+                }
+                current = after;
+                text(std::string_view(out, size_t(total)), key);
+            }
+
+            void cborKey()
+            {
+                unsigned char initial = next();
+                while (initial >> 5 == 6)
+                {
+                    argument(initial & 31);
+                    initial = next();
+                }
+                if (initial >> 5 != 3)
+                    fail("map key is not a text string");
+                cborString(initial & 31, true);
+            }
+
+            void cborValue()
+            {
+                unsigned char initial = next();
+                // tags give meaning to the item that follows, which is read as is
+                while (initial >> 5 == 6)
+                {
+                    argument(initial & 31);
+                    initial = next();
+                }
+                unsigned info = initial & 31;
+                switch (initial >> 5)
+                {
+                case 0:
+                    if (info == 31)
+                        fail("integer of unknown size");
+                    return integer(argument(info));
+                case 1:
+                {
+                    if (info == 31)
+                        fail("integer of unknown size");
+                    uint64_t n = argument(info);
+                    // below -2^63 only a double holds it, as in text
+                    if (n > uint64_t(std::numeric_limits<long long>::max()))
+                        return real(-1.0 - double(n));
+                    return negative(-1 - (long long)n);
+                }
+                case 2:
+                    fail("byte string has no json type");
+                case 3:
+                    return cborString(info, false);
+                case 4:
+                    return start(false, argument(info), info == 31);
+                case 5:
+                    return start(true, argument(info), info == 31);
+                default:
+                    switch (info)
+                    {
+                    case 20:
+                    case 21:
+                        stats::node(booleanType);
+                        return handler.onBool(info == 21);
+                    case 22:
+                    case 23:
+                        // undefined has no json counterpart closer than null
+                        stats::node(nullType);
+                        return handler.onNull();
+                    case 25:
+                        return real(fromHalfBits(uint16_t(big(2))));
+                    case 26:
+                        return real(fromFloatBits(uint32_t(big(4))));
+                    case 27:
+                        return real(fromDoubleBits(big(8)));
+                    case 31:
+                        fail("unexpected break");
+                    default:
+                        fail("simple value has no json type");
+                    }
+                }
+            }
+
+            void packedKey()
+            {
+                unsigned char initial = next();
+                if (initial >= 0xa0 && initial <= 0xbf)
+                    return text(take(initial & 31), true);
+                if (initial < 0xd9 || initial > 0xdb)
+                    fail("map key is not a string");
+                text(take(big(size_t(1) << (initial - 0xd9))), true);
+            }
+
+            void packedValue()
+            {
+                unsigned char initial = next();
+                if (initial < 0x80)
+                    return integer(initial);
+                if (initial >= 0xe0)
+                    return negative((signed char)initial);
+                if (initial < 0x90)
+                    return start(true, initial & 15, false);
+                if (initial < 0xa0)
+                    return start(false, initial & 15, false);
+                if (initial < 0xc0)
+                    return text(take(initial & 31), false);
+                switch (initial)
+                {
+                case 0xc0:
+                    stats::node(nullType);
+                    return handler.onNull();
+                case 0xc2:
+                case 0xc3:
+                    stats::node(booleanType);
+                    return handler.onBool(initial == 0xc3);
+                case 0xca:
+                    return real(fromFloatBits(uint32_t(big(4))));
+                case 0xcb:
+                    return real(fromDoubleBits(big(8)));
+                case 0xcc:
+                case 0xcd:
+                case 0xce:
+                case 0xcf:
+                    return integer(big(size_t(1) << (initial - 0xcc)));
+                case 0xd0:
+                    return negative((int8_t)big(1));
+                case 0xd1:
+                    return negative((int16_t)big(2));
+                case 0xd2:
+                    return negative((int32_t)big(4));
+                case 0xd3:
+                    return negative((long long)big(8));
+                case 0xd9:
+                case 0xda:
+                case 0xdb:
+                    return text(take(big(size_t(1) << (initial - 0xd9))), false);
+                case 0xdc:
+                case 0xdd:
+                    return start(false, big(initial == 0xdc ? 2 : 4), false);
+                case 0xde:
+                case 0xdf:
+                    return start(true, big(initial == 0xde ? 2 : 4), false);
+                case 0xc1:
+                    fail("unused byte 0xc1");
+                default:
+                    fail("binary and extension types have no json type");
+                }
+            }
+
+        public:
+            decoder(const char *data, size_t size, handler_type &h, binary_format f, size_t depth)
+                : begin(reinterpret_cast<const unsigned char *>(data)), current(begin), end(begin + size), handler(h), format(f), maxDepth(depth) {}
+
+            // strings joined from chunks go to the resource, the document
+            // holds on to them like to the input it borrows
+            void keepJoined(std::pmr::memory_resource &resource)
+            {
+                keep = &resource;
+            }
+
+            size_t consumed() const
+            {
+                return size_t(current - begin);
+            }
+
+            void decodeValue()
+            {
+                bool cbor = format == binary_format::cbor;
+                while (true)
+                {
+                    if (cbor)
+                        cborValue();
+                    else
+                        packedValue();
+                    // close every container that is complete, then read
+                    // the key of the next member if it is an object's
+                    while (!open.empty())
+                    {
+                        frame &f = open.back();
+                        if (f.indefinite ? current != end && *current == 0xff : f.left == 0)
+                        {
+                            if (f.indefinite)
+                                ++current;
+                            close();
+                        }
+                        else
+                            break;
+                    }
+                    if (open.empty())
+                        return;
+                    frame &f = open.back();
+                    if (!f.indefinite)
+                        --f.left;
+                    if (f.object)
+                    {
+                        if (cbor)
+                            cborKey();
+                        else
+                            packedKey();
+                    }
+                }
+            }
+        };
+
+        template <typename handler_type>
+        size_t decodeInto(const char *data, size_t size, binary_format format, const parse_options &options, handler_type &handler, bool whole)
+        {
+            decoder<handler_type> d(data, size, handler, format, options.maxDepth);
+            if (options.resource && options.borrowInput)
+                d.keepJoined(*options.resource);
+            d.decodeValue();
+            if (whole && d.consumed() != size)
+                throw json::read_error(format == binary_format::cbor ? "invalid cbor input : unexpected trailing bytes" : "invalid messagepack input : unexpected trailing bytes");
+            return d.consumed();
+        }
+    }
+
+    std::string encode(const json &j, binary_format format)
+    {
+        stats::scope recording(phase::printing);
+        std::string out;
+        encoder(out, format).write(j);
+        stats::wrote(out.size());
+        return out;
+    }
+
+    void encode(const json &j, binary_format format, std::ostream &os)
+    {
+        stats::scope recording(phase::printing);
+        std::string buffer;
+        encoder e(buffer, format, os);
+        e.write(j);
+        e.flush();
+    }
+
+    json decode(const char *data, size_t size, binary_format format, const parse_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(size);
+        dom_builder builder(options);
+        decodeInto(data, size, format, options, builder, true);
+        return builder.result();
+    }
+
+    json decode(std::string_view input, binary_format format, const parse_options &options)
+    {
+        return decode(input.data(), input.size(), format, options);
+    }
+
+    json decode(std::string_view input, binary_format format)
+    {
+        return decode(input.data(), input.size(), format, parse_options());
+    }
+
+    void decode(std::string_view input, binary_format format, sax_handler &handler)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(input.size());
+        decodeInto(input.data(), input.size(), format, parse_options(), handler, true);
+    }
+
+    json decode(std::istream &is, binary_format format)
+    {
+        // buffer what is left of the stream a block at a time, decode one
+        // value out of it and rewind the stream past that value when it is
+        // seekable
+        stats::scope recording(phase::parsing);
+        std::istream::pos_type start = is.tellg();
+        std::string buffer;
+        size_t filled = 0;
+        do
+        {
+            buffer.resize(filled + (1 << 16));
+            is.read(buffer.data() + filled, std::streamsize(buffer.size() - filled));
+            filled += size_t(is.gcount());
+        } while (is);
+        buffer.resize(filled);
+        parse_options options;
+        dom_builder builder(options);
+        size_t consumed = decodeInto(buffer.data(), buffer.size(), format, options, builder, false);
+        json j = builder.result();
+        stats::read(consumed);
+        if (start != std::istream::pos_type(-1))
+        {
+            is.clear();
+            is.seekg(start + std::istream::off_type(consumed));
+        }
+        return j;
+    }
+}
@@ -0,0 +1,416 @@
+#pragma once
+
+#include "../include/json.h"
+#include "stats.h"
+#include <cstring>
+#include <atomic>
+
+namespace badge881::json
+{
+    // one member of an object whose members live in a memory resource, in
+    // document order
+    struct borrowed_member
+    {
+        std::string_view key;
+        json value;
+    };
+
+    // an interned key, allocated once by its key_table with the text right
+    // behind it and never moved or changed
+    struct key_atom
+    {
+        uint32_t hash;
+        uint32_t size;
+
+        const char *text() const
+        {
+            return reinterpret_cast<const char *>(this + 1);
+        }
+    };
+
+    // the key of an owned member with its hash worked out once. sixteen
+    // characters fit inline, longer keys point either to a copy of their
+    // own or to an atom of a key_table
+    class member_key
+    {
+        union
+        {
+            char chars[16];
+            const char *data;
+        };
+        uint32_t length;
+        uint32_t hashValue;
+
+        static constexpr uint32_t sharedBit = 1u << 31;
+
+        bool isInline() const
+        {
+            return length <= 16;
+        }
+
+        bool isShared() const
+        {
+            return length & sharedBit;
+        }
+
+    public:
+        static uint32_t hashOf(std::string_view s)
+        {
+            return uint32_t(std::hash<std::string_view>()(s));
+        }
+
+        member_key(std::string_view s, uint32_t hash);
+        explicit member_key(std::string_view s) : member_key(s, hashOf(s)) {}
+        explicit member_key(const key_atom *atom);
+        member_key(const member_key &other);
+        member_key(member_key &&other) noexcept;
+        member_key &operator=(member_key other) noexcept;
+        ~member_key();
+
+        size_t size() const
+        {
+            return length & ~sharedBit;
+        }
+
+        std::string_view view() const
+        {
+            return std::string_view(isInline() ? chars : data, size());
+        }
+
+        uint32_t hash() const
+        {
+            return hashValue;
+        }
+
+        bool matches(std::string_view s) const
+        {
+            return size() == s.size() && std::memcmp(isInline() ? chars : data, s.data(), s.size()) == 0;
+        }
+
+        bool matches(std::string_view s, uint32_t hash) const
+        {
+            return hashValue == hash && matches(s);
+        }
+
+        bool matches(const key_handle &key) const
+        {
+            if (key.interned() && isShared() && data == key.interned()->text())
+                return true;
+            return matches(key.view(), key.hash());
+        }
+
+        bool operator==(const member_key &other) const
+        {
+            // atoms of one table are the same key exactly when they are the same atom
+            if (isShared() && other.isShared() && data == other.data)
+                return true;
+            return matches(other.view(), other.hashValue);
+        }
+    };
+
+    struct flat_member
+    {
+        member_key key;
+        json value;
+    };
+
+    // owned object storage : members sit in insertion order in one vector
+    // and are found by a scan over their hashes while there are few of them,
+    // larger objects also keep a hash index of member positions
+    class flat_object
+    {
+        std::vector<flat_member> members;
+        // open addressing, position plus one, zero for a free slot
+        std::vector<uint32_t> index;
+
+        static constexpr size_t scanLimit = 16;
+
+        size_t slot(std::string_view key, uint32_t hash) const;
+        void addToIndex(size_t position);
+        void rebuildIndex();
+        const json *find(std::string_view key, uint32_t hash) const;
+        json &append(member_key key, json value);
+
+    public:
+        size_t size() const
+        {
+            return members.size();
+        }
+
+        void reserve(size_t count)
+        {
+            members.reserve(count);
+        }
+
+        void clear()
+        {
+            members.clear();
+            index.clear();
+        }
+
+        std::vector<flat_member>::const_iterator begin() const
+        {
+            return members.begin();
+        }
+
+        std::vector<flat_member>::const_iterator end() const
+        {
+            return members.end();
+        }
+
+        const json *find(std::string_view key) const;
+        const json *find(const key_handle &key) const;
+
+        json *find(std::string_view key)
+        {
+            return const_cast<json *>(static_cast<const flat_object &>(*this).find(key));
+        }
+
+        // a new key goes last, a repeated one keeps its place and takes the value
+        json &assign(member_key key, json value);
+        json &assign(std::string_view key, json value)
+        {
+            return assign(member_key(key), std::move(value));
+        }
+        // null member added last when missing
+        json &operator[](std::string_view key);
+        // moves the members out, the object is empty afterwards
+        std::vector<flat_member> release();
+    };
+
+    // an owned payload with the number of nodes sharing it. a copy of a node
+    // only takes another reference, and a node about to be written clones
+    // the payload first when someone else still holds it. once a mutable
+    // reference into it was handed out the payload is never shared again,
+    // a later copy could not see writes through that reference coming
+    template <typename T>
+    struct counted : T
+    {
+        std::atomic<uint32_t> references{1};
+        bool exposed = false;
+
+        template <typename... argumentsT>
+        explicit counted(argumentsT &&...arguments) : T(std::forward<argumentsT>(arguments)...) {}
+
+        static void *operator new(size_t size)
+        {
+            stats::allocated(size);
+            return ::operator new(size);
+        }
+
+        static void operator delete(void *p)
+        {
+            ::operator delete(p);
+        }
+    };
+
+    template <typename T>
+    counted<T> *addReference(counted<T> *payload) noexcept
+    {
+        payload->references.fetch_add(1, std::memory_order_relaxed);
+        return payload;
+    }
+
+    template <typename T>
+    void dropReference(counted<T> *payload) noexcept
+    {
+        // a sole holder skips the atomic decrement
+        if (payload->references.load(std::memory_order_acquire) == 1 || payload->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete payload;
+    }
+
+    template <typename T>
+    bool isShared(const counted<T> *payload) noexcept
+    {
+        return payload->references.load(std::memory_order_acquire) != 1;
+    }
+
+    // the children are copied too, which only takes a reference to each
+    template <typename T>
+    counted<T> *clonePayload(const counted<T> *payload)
+    {
+        stats::scope recording(phase::copying);
+        return new counted<T>(static_cast<const T &>(*payload));
+    }
+
+    template <typename T>
+    counted<T> *copyPayload(counted<T> *payload)
+    {
+        return payload->exposed ? clonePayload(payload) : addReference(payload);
+    }
+
+    // a payload that may be written and referenced from the outside
+    template <typename T>
+    counted<T> *exposePayload(counted<T> *payload)
+    {
+        if (isShared(payload))
+        {
+            counted<T> *copy = clonePayload(payload);
+            dropReference(payload);
+            payload = copy;
+        }
+        payload->exposed = true;
+        return payload;
+    }
+
+    // the members of an object one at a time whatever their storage, for
+    // the loops that keep a stack of their own instead of recursing
+    class member_cursor
+    {
+        friend class node_access;
+
+        const borrowed_member *borrowedAt = nullptr;
+        std::vector<flat_member>::const_iterator ownedAt;
+        std::unordered_map<std::string, json>::const_iterator mappedAt;
+        size_t left = 0;
+        enum : unsigned char
+        {
+            borrowedMembers,
+            ownedMembers,
+            mappedMembers
+        } storage = borrowedMembers;
+
+    public:
+        bool atEnd() const
+        {
+            return left == 0;
+        }
+
+        std::string_view key() const
+        {
+            switch (storage)
+            {
+            case borrowedMembers:
+                return borrowedAt->key;
+            case ownedMembers:
+                return ownedAt->key.view();
+            default:
+                return mappedAt->first;
+            }
+        }
+
+        const json &value() const
+        {
+            switch (storage)
+            {
+            case borrowedMembers:
+                return borrowedAt->value;
+            case ownedMembers:
+                return ownedAt->value;
+            default:
+                return mappedAt->second;
+            }
+        }
+
+        void next()
+        {
+            --left;
+            switch (storage)
+            {
+            case borrowedMembers:
+                ++borrowedAt;
+                break;
+            case ownedMembers:
+                ++ownedAt;
+                break;
+            default:
+                ++mappedAt;
+            }
+        }
+    };
+
+    // read access to a node however it is stored, and the builders that make
+    // nodes pointing into a memory resource. only for the library's own code
+    class node_access
+    {
+    public:
+        static bool isBorrowed(const json &j)
+        {
+            return j.borrowed;
+        }
+
+        static std::string_view string(const json &j)
+        {
+            if (j.borrowed)
+                return std::string_view(j.dataForChars, j.borrowedSize);
+            return *j.dataForString;
+        }
+
+        static std::pair<const json *, size_t> elements(const json &j)
+        {
+            if (j.borrowed)
+                return {j.dataForElements, j.borrowedSize};
+            return {j.dataForCollection->data(), j.dataForCollection->size()};
+        }
+
+        static size_t memberCount(const json &j)
+        {
+            if (j.borrowed)
+                return j.borrowedSize;
+            return j.mapped ? j.dataForMap->size() : j.dataForObject->size();
+        }
+
+        template <typename functionT>
+        static void forEachMember(const json &j, functionT &&function)
+        {
+            if (j.borrowed)
+                for (uint32_t i = 0; i < j.borrowedSize; ++i)
+                    function(j.dataForMembers[i].key, j.dataForMembers[i].value);
+            else if (j.mapped)
+                for (const auto &[key, value] : *j.dataForMap)
+                    function(std::string_view(key), value);
+            else
+                for (const flat_member &member : *j.dataForObject)
+                    function(member.key.view(), member.value);
+        }
+
+        static member_cursor members(const json &j)
+        {
+            member_cursor cursor;
+            cursor.left = memberCount(j);
+            if (j.borrowed)
+                cursor.borrowedAt = j.dataForMembers;
+            else if (j.mapped)
+            {
+                cursor.storage = member_cursor::mappedMembers;
+                cursor.mappedAt = j.dataForMap->begin();
+            }
+            else
+            {
+                cursor.storage = member_cursor::ownedMembers;
+                cursor.ownedAt = j.dataForObject->begin();
+            }
+            return cursor;
+        }
+
+        // copies sharing a container payload are equal without looking into it
+        static bool samePayload(const json &a, const json &b)
+        {
+            if (a.borrowed || b.borrowed || a.typeName != b.typeName)
+                return false;
+            if (a.typeName == collectionType)
+                return a.dataForCollection == b.dataForCollection;
+            return a.typeName == objectType && a.mapped == b.mapped && a.dataForObject == b.dataForObject;
+        }
+
+        static const json *findMember(const json &j, std::string_view key);
+        static const json *findMember(const json &j, const key_handle &key);
+
+        static json ownedString(std::string_view s);
+        static json ownedObject(counted<flat_object> *members);
+        static json ownedCollection(counted<std::vector<json>> *elements);
+
+        // the builders take storage already allocated from a resource
+        static json borrowedString(const char *data, size_t size);
+        static json borrowedCollection(json *elements, size_t count);
+        static json borrowedObject(borrowed_member *members, size_t count);
+
+        static const char *copyString(std::string_view s, std::pmr::memory_resource &resource);
+        static json *allocateElements(size_t count, std::pmr::memory_resource &resource);
+        static borrowed_member *allocateMembers(size_t count, std::pmr::memory_resource &resource);
+        static size_t removeDuplicates(borrowed_member *members, size_t count);
+
+        // deep copy whose payloads all come from the resource
+        static json copyInto(const json &j, std::pmr::memory_resource &resource);
+    };
+}
@@ -0,0 +1,60 @@
+#include "internals.h"
+#include <mutex>
+#include <new>
+
+namespace badge881::json
+{
+    namespace
+    {
+        // threads interning different keys mostly take different locks
+        constexpr size_t shardCount = 16;
+    }
+
+    struct key_table::shard
+    {
+        std::mutex lock;
+        std::unordered_map<std::string_view, const key_atom *> atoms;
+    };
+
+    key_table::key_table() : shards(new shard[shardCount]) {}
+
+    key_table::~key_table()
+    {
+        for (size_t i = 0; i < shardCount; ++i)
+            for (const auto &[text, atom] : shards[i].atoms)
+                ::operator delete(const_cast<key_atom *>(atom));
+        delete[] shards;
+    }
+
+    const key_atom *key_table::intern(std::string_view key)
+    {
+        uint32_t hash = member_key::hashOf(key);
+        shard &s = shards[hash % shardCount];
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto found = s.atoms.find(key);
+        if (found != s.atoms.end())
+            return found->second;
+        auto *atom = static_cast<key_atom *>(::operator new(sizeof(key_atom) + key.size()));
+        atom->hash = hash;
+        atom->size = uint32_t(key.size());
+        if (!key.empty())
+            std::memcpy(const_cast<char *>(atom->text()), key.data(), key.size());
+        s.atoms.emplace(std::string_view(atom->text(), key.size()), atom);
+        return atom;
+    }
+
+    size_t key_table::size() const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < shardCount; ++i)
+        {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            count += shards[i].atoms.size();
+        }
+        return count;
+    }
+
+    key_handle::key_handle(std::string_view key) : text(key), hashValue(member_key::hashOf(key)) {}
+
+    key_handle::key_handle(key_table &table, std::string_view key) : text(key), hashValue(member_key::hashOf(key)), atom(table.intern(key)) {}
+}
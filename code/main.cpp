@@ -1,651 +1,2842 @@
-#include "../include/json.h"
-#include <sstream>
-#include <fstream>
-
-void std::hash<badge881::json::json>::combine(size_t &hash, const size_t &other) const noexcept
-{
-    hash ^= other + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-}
-
-size_t std::hash<badge881::json::json>::operator()(const badge881::json::json &s) const noexcept
-{
-    size_t hash = 0;
-    if (s.isBoolean())
-        hash = std::hash<bool>{}(s.get<bool>());
-    else if (s.isNumber())
-        hash = std::hash<double>{}(s.get<double>());
-    else if (s.isString())
-        hash = std::hash<std::string>{}(s.get<std::string>());
-    else if (s.isObject())
-        for (const auto &[key, value] : s.get<std::unordered_map<std::string, badge881::json::json>>())
-        {
-            combine(hash, std::hash<std::string>{}(key));
-            combine(hash, std::hash<badge881::json::json>{}(value));
-        }
-    else if (s.isCollection())
-        for (const auto &value : s.get<std::vector<badge881::json::json>>())
-            combine(hash, std::hash<badge881::json::json>{}(value));
-    return hash;
-}
-
-namespace badge881::json
-{
-
-    json::json() : typeName(nullType), dataForNull(nullptr) {}
-
-    json::json(const json &other) : typeName(other.typeName)
-    {
-        switch (typeName)
-        {
-        case nullType:
-            dataForNull = nullptr;
-            break;
-        case booleanType:
-            dataForBoolean = other.dataForBoolean;
-            break;
-        case numberType:
-            dataForNum = other.dataForNum;
-            break;
-        case stringType:
-            dataForString = other.dataForString;
-            break;
-        case objectType:
-            dataForObject = other.dataForObject;
-            break;
-        case collectionType:
-            dataForCollection = other.dataForCollection;
-            break;
-        }
-    }
-
-    json::json(json &&other) : typeName(other.typeName)
-    {
-        switch (typeName)
-        {
-        case nullType:
-            dataForNull = nullptr;
-            break;
-        case booleanType:
-            dataForBoolean = other.dataForBoolean;
-            break;
-        case numberType:
-            dataForNum = other.dataForNum;
-            break;
-        case stringType:
-            dataForString = std::move(other.dataForString);
-            break;
-        case objectType:
-            dataForObject = std::move(other.dataForObject);
-            break;
-        case collectionType:
-            dataForCollection = std::move(other.dataForCollection);
-            break;
-        }
-        other.typeName = nullType;
-        other.dataForNull = nullptr;
-    }
-
-    json::json(const type &t) : typeName(t)
-    {
-        clear();
-    }
-
-    json::json(const std::string &s) : typeName(stringType), dataForString(s) {}
-
-    json::json(const char *s) : typeName(stringType), dataForString(s) {}
-
-    json::json(bool b) : typeName(booleanType), dataForBoolean(b) {}
-
-    json::json(double num) : typeName(numberType), dataForNum(num) {}
-
-    json::json(int num) : typeName(numberType), dataForNum(static_cast<double>(num)) {}
-
-    json::json(unsigned int num) : typeName(numberType), dataForNum(static_cast<double>(num)) {}
-
-    json::json(long long num) : typeName(numberType), dataForNum(static_cast<double>(num)) {}
-
-    json::json(unsigned long long num) : typeName(numberType), dataForNum(static_cast<double>(num)) {}
-
-    json::json(collection col) : typeName(collectionType), dataForCollection(col) {}
-
-    json::json(std::vector<json> col) : typeName(collectionType), dataForCollection(col) {}
-
-    json::json(object obj) : typeName(objectType)
-    {
-        for (const auto &[key, value] : obj)
-        {
-            dataForObject[key] = value;
-        }
-    }
-
-    json::json(std::unordered_map<std::string, json> obj) : typeName(objectType), dataForObject(obj) {}
-
-    json &json::operator=(const type &t)
-    {
-        typeName = t;
-        clear();
-        switch (typeName)
-        {
-        case nullType:
-            dataForNull = nullptr;
-            break;
-        case booleanType:
-            dataForBoolean = false;
-            break;
-        case numberType:
-            dataForNum = 0.0;
-            break;
-        case stringType:
-            dataForString = "";
-            break;
-        case objectType:
-            dataForObject = {};
-            break;
-        case collectionType:
-            dataForCollection = {};
-            break;
-        }
-
-        return *this;
-    }
-
-    json &json::operator=(const json &other)
-    {
-        if (this != &other)
-        {
-            typeName = other.typeName;
-            clear();
-            switch (typeName)
-            {
-            case nullType:
-                dataForNull = nullptr;
-                break;
-            case booleanType:
-                dataForBoolean = other.dataForBoolean;
-                break;
-            case numberType:
-                dataForNum = other.dataForNum;
-                break;
-            case stringType:
-                dataForString = other.dataForString;
-                break;
-            case objectType:
-                dataForObject = other.dataForObject;
-                break;
-            case collectionType:
-                dataForCollection = other.dataForCollection;
-                break;
-            }
-        }
-        return *this;
-    }
-
-    json &json::operator=(json &&other)
-    {
-        if (this != &other)
-        {
-            typeName = other.typeName;
-            clear();
-            switch (typeName)
-            {
-            case nullType:
-                dataForNull = nullptr;
-                break;
-            case booleanType:
-                dataForBoolean = other.dataForBoolean;
-                break;
-            case numberType:
-                dataForNum = other.dataForNum;
-                break;
-            case stringType:
-                dataForString = std::move(other.dataForString);
-                break;
-            case objectType:
-                dataForObject = std::move(other.dataForObject);
-                break;
-            case collectionType:
-                dataForCollection = std::move(other.dataForCollection);
-                break;
-            }
-            other.typeName = nullType;
-            other.dataForNull = nullptr;
-        }
-        return *this;
-    }
-
-    json &json::operator=(const std::string &s)
-    {
-        typeName = stringType;
-        clear();
-        dataForString = s;
-        return *this;
-    }
-
-    json &json::operator=(bool b)
-    {
-        typeName = booleanType;
-        clear();
-        dataForBoolean = b;
-        return *this;
-    }
-
-    json &json::operator=(double num)
-    {
-        typeName = numberType;
-        clear();
-        dataForNum = num;
-        return *this;
-    }
-
-    json &json::operator=(int num)
-    {
-        typeName = numberType;
-        clear();
-        dataForNum = static_cast<double>(num);
-        return *this;
-    }
-
-    json &json::operator=(unsigned int num)
-    {
-        typeName = numberType;
-        clear();
-        dataForNum = static_cast<double>(num);
-        return *this;
-    }
-
-    json &json::operator=(long long num)
-    {
-        typeName = numberType;
-        clear();
-        dataForNum = static_cast<double>(num);
-        return *this;
-    }
-
-    json &json::operator=(unsigned long long num)
-    {
-        typeName = numberType;
-        clear();
-        dataForNum = static_cast<double>(num);
-        return *this;
-    }
-
-    json &json::operator=(collection col)
-    {
-        typeName = collectionType;
-        clear();
-        dataForCollection = col;
-        return *this;
-    }
-
-    json &json::operator=(std::vector<json> col)
-    {
-        typeName = collectionType;
-        clear();
-        dataForCollection = col;
-        return *this;
-    }
-
-    json &json::operator=(object obj)
-    {
-        typeName = objectType;
-        clear();
-        for (const auto &[key, value] : obj)
-            dataForObject[key] = value;
-        return *this;
-    }
-
-    json &json::operator=(std::unordered_map<std::string, json> obj)
-    {
-        typeName = objectType;
-        clear();
-        for (const auto &[key, value] : obj)
-            dataForObject[key] = value;
-        return *this;
-    }
-
-    json::~json()
-    {
-        clear();
-    }
-
-    void json::clear()
-    {
-        dataForNull = nullptr;
-        dataForBoolean = false;
-        dataForNum = 0.0;
-        dataForString = "";
-        dataForObject.clear();
-        dataForCollection.clear();
-    }
-
-    bool json::isNull() const 
-    {
-        return typeName == nullType;
-    }
-
-    bool json::isBoolean() const 
-    {
-        return typeName == booleanType;
-    }
-
-    bool json::isNumber() const 
-    {
-        return typeName == numberType;
-    }
-
-    bool json::isString() const
-    {
-        return typeName == stringType;
-    }
-
-    bool json::isObject() const
-    {
-        return typeName == objectType;
-    }
-
-    bool json::isCollection() const
-    {
-        return typeName == collectionType;
-    }
-
-    type json::getType() const
-    {
-        return typeName;
-    }
-
-    std::string json::getTypeString() const
-    {
-        switch (typeName)
-        {
-        case nullType:
-            return "null";
-        case booleanType:
-            return "boolean";
-        case numberType:
-            return "number";
-        case stringType:
-            return "string";
-        case objectType:
-            return "object";
-        case collectionType:
-            return "collection";
-        }
-        return "null";
-    }
-
-    template <typename T>
-    T &json::get()
-    {
-        throw type_error("given type is not supported");
-    }
-
-    template <>
-    std::nullptr_t &json::get<std::nullptr_t>() 
-    {
-        if (!isNull())
-            throw type_error("json value is not null, type is : \'" + getTypeString() + "\'");
-        return dataForNull;
-    }
-
-    template <>
-    bool &json::get<bool>()
-    {
-        if (!isBoolean())
-            throw type_error("json value is not a boolean, type is : \'" + getTypeString() + "\'");
-        return dataForBoolean;
-    }
-
-    template <>
-    double &json::get<double>()
-    {
-        if (!isNumber())
-            throw type_error("json value is not a number, type is : \'" + getTypeString() + "\'");
-        return dataForNum;
-    }
-
-    template <>
-    std::string &json::get<std::string>()
-    {
-        if (!isString())
-            throw type_error("json value is not a string, type is : \'" + getTypeString() + "\'");
-        return dataForString;
-    }
-
-    template <>
-    std::vector<json> &json::get<std::vector<json>>()
-    {
-        if (!isCollection())
-            throw type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
-        return dataForCollection;
-    }
-
-    template <>
-    std::unordered_map<std::string, json> &json::get<std::unordered_map<std::string, json>>()
-    {
-        if (!isObject())
-            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
-        return dataForObject;
-    }
-
-
-    json &json::operator[](const std::string &key)
-    {
-        if (!isObject())
-            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
-        return dataForObject[key];
-    }
-
-    json &json::operator[](const int &index)
-    {
-        if (!isCollection())
-            throw type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
-        if (index < 0)
-            throw std::out_of_range("index is out of range");
-        if (index >= dataForCollection.size())
-            dataForCollection.resize(index + 1);
-        return dataForCollection[index];
-    }
-
-    bool json::operator==(const json &other) const
-    {
-        if (typeName != other.typeName)
-            return false;
-        switch (typeName)
-        {
-        case nullType:
-            return true;
-        case booleanType:
-            return dataForBoolean == other.dataForBoolean;
-        case numberType:
-            return dataForNum == other.dataForNum;
-        case stringType:
-            return dataForString == other.dataForString;
-        case objectType:
-            return dataForObject == other.dataForObject;
-        case collectionType:
-            return dataForCollection == other.dataForCollection;
-        }
-        return false;
-    }
-
-    bool json::operator!=(const json &other) const
-    {
-        return !operator==(other);
-    }
-
-    std::string print(const json &j)
-    {
-        std::stringstream os;
-
-        switch (j.getType())
-        {
-        case nullType:
-            os << "null";
-            break;
-        case booleanType:
-            os << (j.get<bool>() ? "true" : "false");
-            break;
-        case numberType:
-            os << j.get<double>();
-            break;
-        case stringType:
-            os << "\"" << j.get<std::string>() << "\"";
-            break;
-        case objectType:
-            os << "{";
-            const std::unordered_map<std::string, json>& obj = j.get<std::unordered_map<std::string, json>>();
-            for (auto it = obj.begin(); it != obj.end(); ++it)
-            {
-                if (it != obj.begin())
-                    os << ", ";
-                os << "\"" << it->first << "\": " << print(it->second);
-            }
-            os << "}";
-            break;
-        case collectionType:
-            os << "[";
-            const std::vector<json>& array = j.get<std::vector<json>>();
-            for (size_t i = 0; i < array.size(); ++i)
-            {
-                if (i > 0)
-                    os << ", ";
-                os << print(array[i]);
-            }
-            os << "]";
-            break;
-        }
-        return os.str();
-    }
-
-    void printFile(const json &j, std::string filePath)
-    {
-        std::ofstream os(filePath);
-        os << print(j);
-    }
-
-    std::ostream &operator<<(std::ostream &os, const json &j)
-    {
-        os << print(j);
-        return os;
-    }
-
-    void skipWhitespace(std::istream &is)
-    {
-        while (is.peek() == ' ' || is.peek() == '\n' || is.peek() == '\t' || is.peek() == '\r')
-            is.get();
-    }
-
-    json parse(std::istream &is)
-    {
-        json j;
-        skipWhitespace(is);
-        char start = is.peek();
-
-        if (start == 'n') // should be null
-        {
-            std::string shouldbeNULL;
-            shouldbeNULL.resize(4);
-            is.read(&shouldbeNULL[0], 4);
-            if (shouldbeNULL != "null")
-                throw json::read_error("invalid json input : null error");
-        }
-        else if (start == 't') // should be true
-        {
-            std::string shouldbeTRUE;
-            shouldbeTRUE.resize(4);
-            is.read(&shouldbeTRUE[0], 4);
-            if (shouldbeTRUE != "true")
-                throw json::read_error("invalid json input : true error");
-            j = json(true);
-        }
-        else if (start == 'f') // should be false
-        {
-            std::string shouldbeFALSE;
-            shouldbeFALSE.resize(5);
-            is.read(&shouldbeFALSE[0], 5);
-            if (shouldbeFALSE != "false")
-                throw json::read_error("invalid json input : false error");
-            j = json(false);
-        }
-        else if (auto num = [](char a)
-                 { return isdigit(a) || a == '-' || a == '.'; };
-                 num(start))
-        {
-            std::stringstream current;
-            while (num(is.peek()))
-                current << char(is.get());
-            double value;
-            current >> value;
-            return json(value);
-        }
-        else if (start == '"')
-        {
-            std::string value;
-            char last = is.get(), current = is.get();
-            while (current != '"' || last == '\\')
-            {
-                value += current;
-                last = current;
-                current = is.get();
-            }
-            return json(value);
-        }
-        else if (start == '{')
-        {
-            std::unordered_map<std::string, json> obj;
-
-            skipWhitespace(is);
-            while (is.get() != '}')
-            {
-                std::string key;
-                json value;
-                skipWhitespace(is);
-                char last = is.get(), current = is.get();
-                while (current != '"' || last == '\\')
-                {
-                    key += current;
-                    last = current;
-                    current = is.get();
-                }
-                skipWhitespace(is);
-                if (is.get() != ':')
-                    throw json::read_error("invalid json input : object error");
-                obj[key] = parse(is);
-                skipWhitespace(is);
-            }
-            j = json(obj);
-        }
-        else if (start == '[')
-        {
-            std::vector<json> col;
-
-            while (is.get() != ']')
-            {
-                col.push_back(parse(is));
-                skipWhitespace(is);
-            }
-            j = json(col);
-        }
-        else
-            throw json::read_error("invalid json input : type not found");
-        return j;
-    }
-
-    json parse(std::string input)
-    {
-        std::istringstream is(input);
-        return parse(is);
-    }
-
-    json parseFile(std::string filePath)
-    {
-        std::ifstream is(filePath);
-        return parse(is);
-    }
-
-    std::istream &operator>>(std::istream &is, json &j)
-    {
-        j = parse(is);
-        return is;
-    }
-};
\ No newline at end of file
+#include "../include/json.h"
+#include "structural.h"
+#include "strings.h"
+#include "internals.h"
+#include "mapping.h"
+#include "parser.h"
+#include "stats.h"
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <charconv>
+#include <array>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include <exception>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace badge881::json
+{
+
+    namespace
+    {
+        // whole doubles inside the 64 bit ranges, the upper bounds are 2^63 and 2^64
+        bool fitsSigned(double num)
+        {
+            return num >= -9223372036854775808.0 && num < 9223372036854775808.0 && num == std::trunc(num);
+        }
+
+        bool fitsUnsigned(double num)
+        {
+            return num >= 0.0 && num < 18446744073709551616.0 && num == std::trunc(num);
+        }
+
+        // the containers a copy still has to fill, with what is left of the
+        // source of each and where its members or elements go
+        struct copy_frame
+        {
+            member_cursor members;
+            const json *elements;
+            size_t left;
+            void *target;
+        };
+
+        // an owned copy of a tree whose borrowed containers, however deep,
+        // are copied out in a loop over a stack of those still open. owned
+        // nodes inside keep sharing their payload
+        json copyOut(const json &root)
+        {
+            std::vector<copy_frame> open;
+            // the copy of one node, a container comes out empty and its
+            // contents are filled once it is on the stack
+            auto start = [&open](const json &j) -> json
+            {
+                if (!node_access::isBorrowed(j))
+                    return j;
+                switch (j.getType())
+                {
+                case stringType:
+                    return node_access::ownedString(node_access::string(j));
+                case objectType:
+                {
+                    auto *members = new counted<flat_object>();
+                    members->reserve(node_access::memberCount(j));
+                    open.push_back(copy_frame{node_access::members(j), nullptr, node_access::memberCount(j), members});
+                    return node_access::ownedObject(members);
+                }
+                case collectionType:
+                {
+                    auto [array, count] = node_access::elements(j);
+                    auto *elements = new counted<std::vector<json>>();
+                    elements->reserve(count);
+                    open.push_back(copy_frame{member_cursor(), array, count, elements});
+                    return node_access::ownedCollection(elements);
+                }
+                default:
+                    return j;
+                }
+            };
+            json copy = start(root);
+            while (!open.empty())
+            {
+                copy_frame &f = open.back();
+                if (f.left == 0)
+                {
+                    open.pop_back();
+                    continue;
+                }
+                --f.left;
+                // start may grow the stack, f is not used after it
+                if (!f.elements)
+                {
+                    auto *members = static_cast<counted<flat_object> *>(f.target);
+                    std::string_view key = f.members.key();
+                    const json &value = f.members.value();
+                    f.members.next();
+                    members->assign(key, start(value));
+                }
+                else
+                {
+                    auto *elements = static_cast<counted<std::vector<json>> *>(f.target);
+                    const json &value = *f.elements++;
+                    elements->push_back(start(value));
+                }
+            }
+            return copy;
+        }
+    }
+
+    void json::allocate()
+    {
+        switch (typeName)
+        {
+        case nullType:
+            dataForNull = nullptr;
+            break;
+        case booleanType:
+            dataForBoolean = false;
+            break;
+        case numberType:
+            numberKind = number_kind::real;
+            dataForNum = 0.0;
+            break;
+        case stringType:
+            dataForString = new counted<std::string>();
+            break;
+        case objectType:
+            dataForObject = new counted<flat_object>();
+            break;
+        case collectionType:
+            dataForCollection = new counted<std::vector<json>>();
+            break;
+        }
+    }
+
+    namespace
+    {
+        // containers being released on this thread, one inside the other
+        thread_local unsigned releasing = 0;
+        // containers found beyond releaseDepth, dropped by the release one
+        // level above them
+        thread_local std::vector<json> *dropping = nullptr;
+        constexpr unsigned releaseDepth = 64;
+    }
+
+    void json::release() noexcept
+    {
+        // borrowed payloads go away with their resource
+        if (borrowed)
+        {
+            borrowed = false;
+            borrowedSize = 0;
+            typeName = nullType;
+            dataForNull = nullptr;
+            return;
+        }
+        auto drop = [](json &j) noexcept
+        {
+            switch (j.typeName)
+            {
+            case stringType:
+                dropReference(j.dataForString);
+                break;
+            case objectType:
+                if (j.mapped)
+                    dropReference(j.dataForMap);
+                else
+                    dropReference(j.dataForObject);
+                break;
+            case collectionType:
+                dropReference(j.dataForCollection);
+                break;
+            default:
+                break;
+            }
+            j.typeName = nullType;
+            j.mapped = false;
+            j.dataForNull = nullptr;
+        };
+        // a container going away destroys its children with a call per
+        // level. past releaseDepth levels they are put aside instead, and
+        // the container above them drops them one after the other, so the
+        // stack holds at most releaseDepth calls
+        if (typeName == objectType || typeName == collectionType)
+        {
+            if (releasing + 1 < releaseDepth)
+            {
+                ++releasing;
+                drop(*this);
+                --releasing;
+                return;
+            }
+            if (releasing >= releaseDepth)
+                try
+                {
+                    dropping->emplace_back().steal(*this);
+                    return;
+                }
+                catch (...)
+                {
+                    ++releasing;
+                    drop(*this);
+                    --releasing;
+                    return;
+                }
+            std::vector<json> later;
+            dropping = &later;
+            ++releasing;
+            drop(*this);
+            while (!later.empty())
+            {
+                json next;
+                next.steal(later.back());
+                later.pop_back();
+                drop(next);
+            }
+            dropping = nullptr;
+            --releasing;
+            return;
+        }
+        drop(*this);
+    }
+
+    void json::steal(json &other) noexcept
+    {
+        typeName = other.typeName;
+        borrowed = other.borrowed;
+        mapped = other.mapped;
+        borrowedSize = other.borrowedSize;
+        switch (typeName)
+        {
+        case nullType:
+            dataForNull = nullptr;
+            break;
+        case booleanType:
+            dataForBoolean = other.dataForBoolean;
+            break;
+        case numberType:
+            copyNumber(other);
+            break;
+        case stringType:
+            if (borrowed)
+                dataForChars = other.dataForChars;
+            else
+                dataForString = other.dataForString;
+            break;
+        case objectType:
+            if (borrowed)
+                dataForMembers = other.dataForMembers;
+            else if (mapped)
+                dataForMap = other.dataForMap;
+            else
+                dataForObject = other.dataForObject;
+            break;
+        case collectionType:
+            if (borrowed)
+                dataForElements = other.dataForElements;
+            else
+                dataForCollection = other.dataForCollection;
+            break;
+        }
+        other.typeName = nullType;
+        other.borrowed = false;
+        other.mapped = false;
+        other.borrowedSize = 0;
+        other.dataForNull = nullptr;
+    }
+
+    bool json::writable() const
+    {
+        if (borrowed)
+            return false;
+        switch (typeName)
+        {
+        case stringType:
+            return !isShared(dataForString);
+        case objectType:
+            return mapped ? !isShared(dataForMap) : !isShared(dataForObject);
+        case collectionType:
+            return !isShared(dataForCollection);
+        default:
+            return true;
+        }
+    }
+
+    void json::own()
+    {
+        // the children stay where they are, in the resource or shared with
+        // other copies, only this node gets storage of its own, so a
+        // mutation copies a single path
+        if (!borrowed)
+        {
+            switch (typeName)
+            {
+            case stringType:
+                dataForString = exposePayload(dataForString);
+                break;
+            case objectType:
+                if (mapped)
+                    dataForMap = exposePayload(dataForMap);
+                else
+                    dataForObject = exposePayload(dataForObject);
+                break;
+            case collectionType:
+                dataForCollection = exposePayload(dataForCollection);
+                break;
+            default:
+                break;
+            }
+            return;
+        }
+        switch (typeName)
+        {
+        case stringType:
+        {
+            dataForString = new counted<std::string>(dataForChars, borrowedSize);
+            dataForString->exposed = true;
+            break;
+        }
+        case objectType:
+        {
+            auto *obj = new counted<flat_object>();
+            obj->reserve(borrowedSize);
+            for (uint32_t i = 0; i < borrowedSize; ++i)
+                obj->assign(dataForMembers[i].key, std::move(dataForMembers[i].value));
+            obj->exposed = true;
+            dataForObject = obj;
+            break;
+        }
+        case collectionType:
+        {
+            auto *col = new counted<std::vector<json>>();
+            col->reserve(borrowedSize);
+            for (uint32_t i = 0; i < borrowedSize; ++i)
+                col->push_back(std::move(dataForElements[i]));
+            col->exposed = true;
+            dataForCollection = col;
+            break;
+        }
+        default:
+            break;
+        }
+        borrowed = false;
+        borrowedSize = 0;
+    }
+
+    void json::copyNumber(const json &other) noexcept
+    {
+        numberKind = other.numberKind;
+        switch (numberKind)
+        {
+        case number_kind::real:
+            dataForNum = other.dataForNum;
+            break;
+        case number_kind::integer:
+            dataForInt = other.dataForInt;
+            break;
+        case number_kind::unsignedInteger:
+            dataForUInt = other.dataForUInt;
+            break;
+        }
+    }
+
+    json::json() : typeName(nullType), dataForNull(nullptr) {}
+
+    json::json(const json &other) : typeName(other.typeName)
+    {
+        stats::scope recording(phase::copying);
+        // owned payloads are shared, borrowed ones copied out of their resource
+        if (!other.borrowed)
+            switch (typeName)
+            {
+            case stringType:
+                dataForString = copyPayload(other.dataForString);
+                return;
+            case objectType:
+                mapped = other.mapped;
+                if (mapped)
+                    dataForMap = copyPayload(other.dataForMap);
+                else
+                    dataForObject = copyPayload(other.dataForObject);
+                return;
+            case collectionType:
+                dataForCollection = copyPayload(other.dataForCollection);
+                return;
+            default:
+                break;
+            }
+        switch (typeName)
+        {
+        case nullType:
+            dataForNull = nullptr;
+            break;
+        case booleanType:
+            dataForBoolean = other.dataForBoolean;
+            break;
+        case numberType:
+            copyNumber(other);
+            break;
+        case stringType:
+            dataForString = new counted<std::string>(node_access::string(other));
+            break;
+        case objectType:
+        case collectionType:
+        {
+            json built = copyOut(other);
+            steal(built);
+            break;
+        }
+        }
+    }
+
+    json::json(json &&other) noexcept
+    {
+        steal(other);
+    }
+
+    json::json(const type &t) : typeName(t)
+    {
+        allocate();
+    }
+
+    json::json(const std::string &s) : typeName(stringType), dataForString(new counted<std::string>(s)) {}
+
+    json::json(const char *s) : typeName(stringType), dataForString(new counted<std::string>(s)) {}
+
+    json::json(bool b) : typeName(booleanType), dataForBoolean(b) {}
+
+    json::json(double num) : typeName(numberType), dataForNum(num) {}
+
+    json::json(int num) : typeName(numberType), numberKind(number_kind::integer), dataForInt(num) {}
+
+    json::json(unsigned int num) : typeName(numberType), numberKind(number_kind::integer), dataForInt(num) {}
+
+    json::json(long long num) : typeName(numberType), numberKind(number_kind::integer), dataForInt(num) {}
+
+    json::json(unsigned long long num) : typeName(numberType)
+    {
+        // unsigned storage is only needed past the signed range
+        if (num <= static_cast<unsigned long long>(LLONG_MAX))
+        {
+            numberKind = number_kind::integer;
+            dataForInt = static_cast<long long>(num);
+        }
+        else
+        {
+            numberKind = number_kind::unsignedInteger;
+            dataForUInt = num;
+        }
+    }
+
+    json::json(collection col) : typeName(collectionType), dataForCollection(new counted<std::vector<json>>(col)) {}
+
+    json::json(std::vector<json> col) : typeName(collectionType), dataForCollection(new counted<std::vector<json>>(std::move(col))) {}
+
+    json::json(object obj) : typeName(objectType), dataForObject(new counted<flat_object>())
+    {
+        dataForObject->reserve(obj.size());
+        for (const auto &[key, value] : obj)
+        {
+            dataForObject->assign(key, value);
+        }
+    }
+
+    json::json(std::unordered_map<std::string, json> obj) : typeName(objectType), dataForObject(new counted<flat_object>())
+    {
+        dataForObject->reserve(obj.size());
+        for (auto &[key, value] : obj)
+            dataForObject->assign(key, std::move(value));
+    }
+
+    json::json(const json &other, std::pmr::memory_resource &resource) : json(node_access::copyInto(other, resource)) {}
+
+    json::json(std::string_view s, std::pmr::memory_resource &resource) : json(node_access::borrowedString(node_access::copyString(s, resource), s.size())) {}
+
+    json::json(const std::string &s, std::pmr::memory_resource &resource) : json(std::string_view(s), resource) {}
+
+    json::json(const char *s, std::pmr::memory_resource &resource) : json(std::string_view(s), resource) {}
+
+    json::json(collection col, std::pmr::memory_resource &resource)
+    {
+        json *elements = node_access::allocateElements(col.size(), resource);
+        size_t count = 0;
+        for (const json &value : col)
+            new (elements + count++) json(node_access::copyInto(value, resource));
+        json built = node_access::borrowedCollection(elements, count);
+        steal(built);
+    }
+
+    json::json(object obj, std::pmr::memory_resource &resource)
+    {
+        borrowed_member *members = node_access::allocateMembers(obj.size(), resource);
+        size_t count = 0;
+        for (const auto &[key, value] : obj)
+            new (members + count++) borrowed_member{std::string_view(node_access::copyString(key, resource), key.size()), node_access::copyInto(value, resource)};
+        json built = node_access::borrowedObject(members, node_access::removeDuplicates(members, count));
+        steal(built);
+    }
+
+    json &json::operator=(const type &t)
+    {
+        release();
+        typeName = t;
+        allocate();
+        return *this;
+    }
+
+    json &json::operator=(const json &other)
+    {
+        if (this != &other)
+        {
+            // copy first: other may live inside this node
+            json copy(other);
+            release();
+            steal(copy);
+        }
+        return *this;
+    }
+
+    json &json::operator=(json &&other) noexcept
+    {
+        if (this != &other)
+        {
+            json moved(std::move(other));
+            release();
+            steal(moved);
+        }
+        return *this;
+    }
+
+    json &json::operator=(const std::string &s)
+    {
+        return *this = json(s);
+    }
+
+    json &json::operator=(bool b)
+    {
+        release();
+        typeName = booleanType;
+        dataForBoolean = b;
+        return *this;
+    }
+
+    json &json::operator=(double num)
+    {
+        release();
+        typeName = numberType;
+        numberKind = number_kind::real;
+        dataForNum = num;
+        return *this;
+    }
+
+    json &json::operator=(int num)
+    {
+        return *this = json(num);
+    }
+
+    json &json::operator=(unsigned int num)
+    {
+        return *this = json(num);
+    }
+
+    json &json::operator=(long long num)
+    {
+        return *this = json(num);
+    }
+
+    json &json::operator=(unsigned long long num)
+    {
+        return *this = json(num);
+    }
+
+    json &json::operator=(collection col)
+    {
+        return *this = json(col);
+    }
+
+    json &json::operator=(std::vector<json> col)
+    {
+        return *this = json(std::move(col));
+    }
+
+    json &json::operator=(object obj)
+    {
+        return *this = json(obj);
+    }
+
+    json &json::operator=(std::unordered_map<std::string, json> obj)
+    {
+        return *this = json(std::move(obj));
+    }
+
+    json::~json()
+    {
+        release();
+    }
+
+    void json::clear()
+    {
+        switch (typeName)
+        {
+        case nullType:
+            dataForNull = nullptr;
+            break;
+        case booleanType:
+            dataForBoolean = false;
+            break;
+        case numberType:
+            numberKind = number_kind::real;
+            dataForNum = 0.0;
+            break;
+        case stringType:
+        case objectType:
+        case collectionType:
+            if (borrowed)
+                borrowedSize = 0;
+            else if (!writable())
+            {
+                // other copies keep the contents, this one starts afresh
+                type t = typeName;
+                release();
+                typeName = t;
+                allocate();
+            }
+            else if (typeName == stringType)
+                dataForString->clear();
+            else if (typeName == objectType && mapped)
+                dataForMap->clear();
+            else if (typeName == objectType)
+                dataForObject->clear();
+            else
+                dataForCollection->clear();
+            break;
+        }
+    }
+
+    bool json::isNull() const 
+    {
+        return typeName == nullType;
+    }
+
+    bool json::isBoolean() const 
+    {
+        return typeName == booleanType;
+    }
+
+    bool json::isNumber() const 
+    {
+        return typeName == numberType;
+    }
+
+    bool json::isInteger() const
+    {
+        return typeName == numberType && numberKind != number_kind::real;
+    }
+
+    bool json::isString() const
+    {
+        return typeName == stringType;
+    }
+
+    bool json::isObject() const
+    {
+        return typeName == objectType;
+    }
+
+    bool json::isCollection() const
+    {
+        return typeName == collectionType;
+    }
+
+    type json::getType() const
+    {
+        return typeName;
+    }
+
+    std::string json::getTypeString() const
+    {
+        switch (typeName)
+        {
+        case nullType:
+            return "null";
+        case booleanType:
+            return "boolean";
+        case numberType:
+            return "number";
+        case stringType:
+            return "string";
+        case objectType:
+            return "object";
+        case collectionType:
+            return "collection";
+        }
+        return "null";
+    }
+
+    template <typename T>
+    T &json::get()
+    {
+        throw type_error("given type is not supported");
+    }
+
+    template <typename T>
+    T json::get() const
+    {
+        throw type_error("given type is not supported");
+    }
+
+    template <>
+    std::nullptr_t json::get<std::nullptr_t>() const
+    {
+        if (!isNull())
+            throw type_error("json value is not null, type is : \'" + getTypeString() + "\'");
+        return nullptr;
+    }
+
+    template <>
+    std::nullptr_t &json::get<std::nullptr_t>()
+    {
+        static_cast<const json &>(*this).get<std::nullptr_t>();
+        return dataForNull;
+    }
+
+    template <>
+    bool json::get<bool>() const
+    {
+        if (!isBoolean())
+            throw type_error("json value is not a boolean, type is : \'" + getTypeString() + "\'");
+        return dataForBoolean;
+    }
+
+    template <>
+    bool &json::get<bool>()
+    {
+        static_cast<const json &>(*this).get<bool>();
+        return dataForBoolean;
+    }
+
+    template <>
+    double json::get<double>() const
+    {
+        if (!isNumber())
+            throw type_error("json value is not a number, type is : \'" + getTypeString() + "\'");
+        switch (numberKind)
+        {
+        case number_kind::integer:
+            return static_cast<double>(dataForInt);
+        case number_kind::unsignedInteger:
+            return static_cast<double>(dataForUInt);
+        default:
+            return dataForNum;
+        }
+    }
+
+    // the reference accessors switch the stored number to the requested
+    // representation, integers only when the value converts exactly
+    template <>
+    double &json::get<double>()
+    {
+        double value = static_cast<const json &>(*this).get<double>();
+        numberKind = number_kind::real;
+        dataForNum = value;
+        return dataForNum;
+    }
+
+    template <>
+    long long json::get<long long>() const
+    {
+        if (!isNumber())
+            throw type_error("json value is not a number, type is : \'" + getTypeString() + "\'");
+        switch (numberKind)
+        {
+        case number_kind::integer:
+            return dataForInt;
+        case number_kind::unsignedInteger:
+            break;
+        case number_kind::real:
+            if (fitsSigned(dataForNum))
+                return static_cast<long long>(dataForNum);
+            break;
+        }
+        throw type_error("json number does not fit a long long");
+    }
+
+    template <>
+    long long &json::get<long long>()
+    {
+        long long value = static_cast<const json &>(*this).get<long long>();
+        numberKind = number_kind::integer;
+        dataForInt = value;
+        return dataForInt;
+    }
+
+    template <>
+    unsigned long long json::get<unsigned long long>() const
+    {
+        if (!isNumber())
+            throw type_error("json value is not a number, type is : \'" + getTypeString() + "\'");
+        switch (numberKind)
+        {
+        case number_kind::integer:
+            if (dataForInt >= 0)
+                return static_cast<unsigned long long>(dataForInt);
+            break;
+        case number_kind::unsignedInteger:
+            return dataForUInt;
+        case number_kind::real:
+            if (fitsUnsigned(dataForNum))
+                return static_cast<unsigned long long>(dataForNum);
+            break;
+        }
+        throw type_error("json number does not fit an unsigned long long");
+    }
+
+    template <>
+    unsigned long long &json::get<unsigned long long>()
+    {
+        unsigned long long value = static_cast<const json &>(*this).get<unsigned long long>();
+        numberKind = number_kind::unsignedInteger;
+        dataForUInt = value;
+        return dataForUInt;
+    }
+
+    template <>
+    std::string json::get<std::string>() const
+    {
+        return std::string(getStringView());
+    }
+
+    template <>
+    std::string &json::get<std::string>()
+    {
+        getStringView();
+        own();
+        return *dataForString;
+    }
+
+    template <>
+    std::vector<json> json::get<std::vector<json>>() const
+    {
+        if (!isCollection())
+            throw type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
+        auto [first, count] = node_access::elements(*this);
+        return std::vector<json>(first, first + count);
+    }
+
+    template <>
+    std::vector<json> &json::get<std::vector<json>>()
+    {
+        if (!isCollection())
+            throw type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
+        own();
+        return *dataForCollection;
+    }
+
+    template <>
+    std::unordered_map<std::string, json> json::get<std::unordered_map<std::string, json>>() const
+    {
+        if (!isObject())
+            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        if (mapped)
+            return *dataForMap;
+        std::unordered_map<std::string, json> obj;
+        obj.reserve(node_access::memberCount(*this));
+        node_access::forEachMember(*this, [&obj](std::string_view key, const json &value)
+                                   { obj.insert_or_assign(std::string(key), value); });
+        return obj;
+    }
+
+    template <>
+    std::unordered_map<std::string, json> &json::get<std::unordered_map<std::string, json>>()
+    {
+        if (!isObject())
+            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        own();
+        if (!mapped)
+        {
+            // the compatibility form, member order is lost from here on
+            auto *map = new counted<std::unordered_map<std::string, json>>();
+            std::vector<flat_member> members = dataForObject->release();
+            map->reserve(members.size());
+            for (flat_member &member : members)
+                map->emplace(std::string(member.key.view()), std::move(member.value));
+            dropReference(dataForObject);
+            map->exposed = true;
+            dataForMap = map;
+            mapped = true;
+        }
+        return *dataForMap;
+    }
+
+    std::string_view json::getStringView() const
+    {
+        if (!isString())
+            throw type_error("json value is not a string, type is : \'" + getTypeString() + "\'");
+        return node_access::string(*this);
+    }
+
+    json &json::operator[](std::string_view key)
+    {
+        if (!isObject())
+            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        own();
+        if (mapped)
+            return (*dataForMap)[std::string(key)];
+        return (*dataForObject)[key];
+    }
+
+    const json *json::find(std::string_view key) const
+    {
+        if (!isObject())
+            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        return node_access::findMember(*this, key);
+    }
+
+    json *json::find(std::string_view key)
+    {
+        const json *found = static_cast<const json &>(*this).find(key);
+        if (!found || writable())
+            return const_cast<json *>(found);
+        own();
+        return const_cast<json *>(node_access::findMember(*this, key));
+    }
+
+    const json *json::find(const key_handle &key) const
+    {
+        if (!isObject())
+            throw type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        return node_access::findMember(*this, key);
+    }
+
+    json *json::find(const key_handle &key)
+    {
+        const json *found = static_cast<const json &>(*this).find(key);
+        if (!found || writable())
+            return const_cast<json *>(found);
+        own();
+        return const_cast<json *>(node_access::findMember(*this, key));
+    }
+
+    const json &json::at(std::string_view key) const
+    {
+        if (const json *found = find(key))
+            return *found;
+        throw std::out_of_range("no member named : " + std::string(key));
+    }
+
+    json &json::at(std::string_view key)
+    {
+        if (json *found = find(key))
+            return *found;
+        throw std::out_of_range("no member named : " + std::string(key));
+    }
+
+    const json &json::at(const key_handle &key) const
+    {
+        if (const json *found = find(key))
+            return *found;
+        throw std::out_of_range("no member named : " + std::string(key.view()));
+    }
+
+    json &json::at(const key_handle &key)
+    {
+        if (json *found = find(key))
+            return *found;
+        throw std::out_of_range("no member named : " + std::string(key.view()));
+    }
+
+    bool json::contains(std::string_view key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    bool json::contains(const key_handle &key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    json &json::operator[](const int &index)
+    {
+        if (!isCollection())
+            throw type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
+        if (index < 0)
+            throw std::out_of_range("index is out of range");
+        own();
+        if (size_t(index) >= dataForCollection->size())
+            dataForCollection->resize(size_t(index) + 1);
+        return (*dataForCollection)[index];
+    }
+
+    namespace
+    {
+        // compares two containers from a stack of pairs instead of a call
+        // per level : scalar children right away, containers in document
+        // order once their turn comes. the stack stays empty, and
+        // unallocated, for flat containers
+        bool sameContainers(const json &first, const json &second)
+        {
+            std::vector<std::pair<const json *, const json *>> pending;
+            auto sameChildren = [&](const json &a, const json &b)
+            {
+                // copies sharing a payload are equal without looking into it
+                if (node_access::samePayload(a, b))
+                    return true;
+                size_t mark = pending.size();
+                auto same = [&](const json &x, const json &y)
+                {
+                    type t = x.getType();
+                    if (t != y.getType())
+                        return false;
+                    if (t == objectType || t == collectionType)
+                    {
+                        pending.emplace_back(&x, &y);
+                        return true;
+                    }
+                    return x == y;
+                };
+                if (a.getType() == objectType)
+                {
+                    if (node_access::memberCount(a) != node_access::memberCount(b))
+                        return false;
+                    bool equal = true;
+                    node_access::forEachMember(a, [&](std::string_view key, const json &value)
+                                               {
+                                                   if (equal)
+                                                   {
+                                                       const json *found = node_access::findMember(b, key);
+                                                       equal = found && same(value, *found);
+                                                   } });
+                    if (!equal)
+                        return false;
+                }
+                else
+                {
+                    auto [elements, count] = node_access::elements(a);
+                    auto [otherElements, otherCount] = node_access::elements(b);
+                    if (count != otherCount)
+                        return false;
+                    for (size_t i = 0; i < count; ++i)
+                        if (!same(elements[i], otherElements[i]))
+                            return false;
+                }
+                // the first child comes off the stack first
+                std::reverse(pending.begin() + mark, pending.end());
+                return true;
+            };
+            if (!sameChildren(first, second))
+                return false;
+            while (!pending.empty())
+            {
+                auto [a, b] = pending.back();
+                pending.pop_back();
+                if (!sameChildren(*a, *b))
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    bool json::operator==(const json &other) const
+    {
+        if (typeName != other.typeName)
+            return false;
+        switch (typeName)
+        {
+        case nullType:
+            return true;
+        case booleanType:
+            return dataForBoolean == other.dataForBoolean;
+        case numberType:
+            return sameNumber(other);
+        case stringType:
+            return node_access::string(*this) == node_access::string(other);
+        case objectType:
+        case collectionType:
+            return sameContainers(*this, other);
+        }
+        return false;
+    }
+
+    bool json::sameNumber(const json &other) const
+    {
+        if (numberKind == other.numberKind)
+        {
+            switch (numberKind)
+            {
+            case number_kind::real:
+                return dataForNum == other.dataForNum;
+            case number_kind::integer:
+                return dataForInt == other.dataForInt;
+            case number_kind::unsignedInteger:
+                return dataForUInt == other.dataForUInt;
+            }
+        }
+        // integers only equal a double that holds exactly the same value
+        if (numberKind == number_kind::real || other.numberKind == number_kind::real)
+        {
+            const json &real = numberKind == number_kind::real ? *this : other;
+            const json &integer = numberKind == number_kind::real ? other : *this;
+            if (integer.numberKind == number_kind::integer)
+                return fitsSigned(real.dataForNum) && static_cast<long long>(real.dataForNum) == integer.dataForInt;
+            return fitsUnsigned(real.dataForNum) && static_cast<unsigned long long>(real.dataForNum) == integer.dataForUInt;
+        }
+        // signed storage is only used below the unsigned range
+        return false;
+    }
+
+    bool json::operator!=(const json &other) const
+    {
+        return !operator==(other);
+    }
+
+    member_key::member_key(std::string_view s, uint32_t hash) : length(uint32_t(s.size())), hashValue(hash)
+    {
+        if (isInline())
+        {
+            // an empty key may come with a null pointer, which memcpy
+            // does not take even for no bytes
+            if (!s.empty())
+                std::memcpy(chars, s.data(), s.size());
+        }
+        else
+        {
+            char *copy = new char[s.size()];
+            std::memcpy(copy, s.data(), s.size());
+            data = copy;
+        }
+    }
+
+    member_key::member_key(const key_atom *atom) : length(atom->size), hashValue(atom->hash)
+    {
+        if (isInline())
+            std::memcpy(chars, atom->text(), atom->size);
+        else
+        {
+            data = atom->text();
+            length |= sharedBit;
+        }
+    }
+
+    member_key::member_key(const member_key &other) : length(other.length), hashValue(other.hashValue)
+    {
+        if (isInline() || isShared())
+            std::memcpy(chars, other.chars, sizeof(chars));
+        else
+        {
+            char *copy = new char[size()];
+            std::memcpy(copy, other.data, size());
+            data = copy;
+        }
+    }
+
+    member_key::member_key(member_key &&other) noexcept : length(other.length), hashValue(other.hashValue)
+    {
+        std::memcpy(chars, other.chars, sizeof(chars));
+        other.length = 0;
+    }
+
+    member_key &member_key::operator=(member_key other) noexcept
+    {
+        std::swap(chars, other.chars);
+        std::swap(length, other.length);
+        std::swap(hashValue, other.hashValue);
+        return *this;
+    }
+
+    member_key::~member_key()
+    {
+        if (!isInline() && !isShared())
+            delete[] data;
+    }
+
+    size_t flat_object::slot(std::string_view key, uint32_t hash) const
+    {
+        size_t mask = index.size() - 1, i = hash & mask;
+        while (index[i] && !members[index[i] - 1].key.matches(key, hash))
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void flat_object::addToIndex(size_t position)
+    {
+        // kept at most half full
+        if ((position + 1) * 2 > index.size())
+            return rebuildIndex();
+        const member_key &key = members[position].key;
+        index[slot(key.view(), key.hash())] = uint32_t(position + 1);
+    }
+
+    void flat_object::rebuildIndex()
+    {
+        size_t size = 64;
+        while (size < members.size() * 2)
+            size *= 2;
+        index.assign(size, 0);
+        for (size_t i = 0; i < members.size(); ++i)
+            index[slot(members[i].key.view(), members[i].key.hash())] = uint32_t(i + 1);
+    }
+
+    const json *flat_object::find(std::string_view key, uint32_t hash) const
+    {
+        if (!index.empty())
+        {
+            uint32_t position = index[slot(key, hash)];
+            return position ? &members[position - 1].value : nullptr;
+        }
+        for (const flat_member &member : members)
+            if (member.key.matches(key, hash))
+                return &member.value;
+        return nullptr;
+    }
+
+    const json *flat_object::find(std::string_view key) const
+    {
+        // a short scan compares lengths first and needs no hash of the key
+        if (!index.empty())
+            return find(key, member_key::hashOf(key));
+        for (const flat_member &member : members)
+            if (member.key.matches(key))
+                return &member.value;
+        return nullptr;
+    }
+
+    const json *flat_object::find(const key_handle &key) const
+    {
+        if (!index.empty())
+        {
+            size_t mask = index.size() - 1, i = key.hash() & mask;
+            while (index[i] && !members[index[i] - 1].key.matches(key))
+                i = (i + 1) & mask;
+            return index[i] ? &members[index[i] - 1].value : nullptr;
+        }
+        for (const flat_member &member : members)
+            if (member.key.matches(key))
+                return &member.value;
+        return nullptr;
+    }
+
+    json &flat_object::assign(member_key key, json value)
+    {
+        if (json *found = const_cast<json *>(find(key.view(), key.hash())))
+            return *found = std::move(value);
+        return append(std::move(key), std::move(value));
+    }
+
+    json &flat_object::append(member_key key, json value)
+    {
+        members.push_back(flat_member{std::move(key), std::move(value)});
+        if (members.size() > scanLimit)
+            addToIndex(members.size() - 1);
+        return members.back().value;
+    }
+
+    json &flat_object::operator[](std::string_view key)
+    {
+        if (json *found = find(key))
+            return *found;
+        return append(member_key(key), json());
+    }
+
+    std::vector<flat_member> flat_object::release()
+    {
+        index.clear();
+        return std::move(members);
+    }
+
+    const json *node_access::findMember(const json &j, std::string_view key)
+    {
+        if (j.mapped)
+        {
+            auto it = j.dataForMap->find(std::string(key));
+            return it == j.dataForMap->end() ? nullptr : &it->second;
+        }
+        if (!j.borrowed)
+            return j.dataForObject->find(key);
+        for (uint32_t i = 0; i < j.borrowedSize; ++i)
+            if (j.dataForMembers[i].key == key)
+                return &j.dataForMembers[i].value;
+        return nullptr;
+    }
+
+    const json *node_access::findMember(const json &j, const key_handle &key)
+    {
+        if (j.mapped || j.borrowed)
+            return findMember(j, key.view());
+        return j.dataForObject->find(key);
+    }
+
+    namespace
+    {
+        void checkBorrowedSize(size_t size)
+        {
+            if (size > UINT32_MAX)
+                throw std::length_error("json value is too large for a memory resource");
+        }
+    }
+
+    json node_access::ownedString(std::string_view s)
+    {
+        json j;
+        j.typeName = stringType;
+        j.dataForString = new counted<std::string>(s);
+        // beyond the short string buffer
+        if (s.size() >= sizeof(std::string))
+            stats::allocated(s.size() + 1);
+        return j;
+    }
+
+    json node_access::ownedObject(counted<flat_object> *members)
+    {
+        json j;
+        j.typeName = objectType;
+        j.dataForObject = members;
+        return j;
+    }
+
+    json node_access::ownedCollection(counted<std::vector<json>> *elements)
+    {
+        json j;
+        j.typeName = collectionType;
+        j.dataForCollection = elements;
+        return j;
+    }
+
+    json node_access::borrowedString(const char *data, size_t size)
+    {
+        checkBorrowedSize(size);
+        json j;
+        j.typeName = stringType;
+        j.borrowed = true;
+        j.borrowedSize = uint32_t(size);
+        j.dataForChars = data;
+        return j;
+    }
+
+    json node_access::borrowedCollection(json *elements, size_t count)
+    {
+        checkBorrowedSize(count);
+        json j;
+        j.typeName = collectionType;
+        j.borrowed = true;
+        j.borrowedSize = uint32_t(count);
+        j.dataForElements = elements;
+        return j;
+    }
+
+    json node_access::borrowedObject(borrowed_member *members, size_t count)
+    {
+        checkBorrowedSize(count);
+        json j;
+        j.typeName = objectType;
+        j.borrowed = true;
+        j.borrowedSize = uint32_t(count);
+        j.dataForMembers = members;
+        return j;
+    }
+
+    const char *node_access::copyString(std::string_view s, std::pmr::memory_resource &resource)
+    {
+        if (s.empty())
+            return nullptr;
+        stats::allocated(s.size());
+        char *data = static_cast<char *>(resource.allocate(s.size(), 1));
+        std::memcpy(data, s.data(), s.size());
+        return data;
+    }
+
+    json *node_access::allocateElements(size_t count, std::pmr::memory_resource &resource)
+    {
+        if (count == 0)
+            return nullptr;
+        stats::allocated(count * sizeof(json));
+        return static_cast<json *>(resource.allocate(count * sizeof(json), alignof(json)));
+    }
+
+    borrowed_member *node_access::allocateMembers(size_t count, std::pmr::memory_resource &resource)
+    {
+        if (count == 0)
+            return nullptr;
+        stats::allocated(count * sizeof(borrowed_member));
+        return static_cast<borrowed_member *>(resource.allocate(count * sizeof(borrowed_member), alignof(borrowed_member)));
+    }
+
+    size_t node_access::removeDuplicates(borrowed_member *members, size_t count)
+    {
+        // a repeated key keeps its first place and its last value, as
+        // inserting into a map would
+        auto merge = [&](size_t kept, size_t &i)
+        {
+            members[kept].value = std::move(members[i].value);
+        };
+        size_t size = 0;
+        if (count <= 32)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t j = 0;
+                while (j < size && members[j].key != members[i].key)
+                    ++j;
+                if (j < size)
+                    merge(j, i);
+                else if (size++ != i)
+                    members[size - 1] = std::move(members[i]);
+            }
+            return size;
+        }
+        std::unordered_map<std::string_view, size_t> seen;
+        seen.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto [it, inserted] = seen.emplace(members[i].key, size);
+            if (!inserted)
+                merge(it->second, i);
+            else if (size++ != i)
+                members[size - 1] = std::move(members[i]);
+        }
+        return size;
+    }
+
+    json node_access::copyInto(const json &root, std::pmr::memory_resource &resource)
+    {
+        // every container is allocated at its final size and filled in a
+        // loop over a stack of those still open, as in copyOut
+        std::vector<copy_frame> open;
+        auto start = [&](const json &j) -> json
+        {
+            switch (j.typeName)
+            {
+            case stringType:
+            {
+                std::string_view s = string(j);
+                return borrowedString(copyString(s, resource), s.size());
+            }
+            case objectType:
+            {
+                size_t count = memberCount(j);
+                borrowed_member *members = allocateMembers(count, resource);
+                open.push_back(copy_frame{node_access::members(j), nullptr, count, members});
+                return borrowedObject(members, count);
+            }
+            case collectionType:
+            {
+                auto [array, count] = elements(j);
+                json *target = allocateElements(count, resource);
+                open.push_back(copy_frame{member_cursor(), array, count, target});
+                return borrowedCollection(target, count);
+            }
+            default:
+                return j;
+            }
+        };
+        json copy = start(root);
+        while (!open.empty())
+        {
+            copy_frame &f = open.back();
+            if (f.left == 0)
+            {
+                open.pop_back();
+                continue;
+            }
+            --f.left;
+            if (!f.elements)
+            {
+                borrowed_member *slot = static_cast<borrowed_member *>(f.target);
+                f.target = slot + 1;
+                std::string_view key = f.members.key();
+                const json &value = f.members.value();
+                f.members.next();
+                new (slot) borrowed_member{std::string_view(copyString(key, resource), key.size()), start(value)};
+            }
+            else
+            {
+                json *slot = static_cast<json *>(f.target);
+                f.target = slot + 1;
+                const json &value = *f.elements++;
+                new (slot) json(start(value));
+            }
+        }
+        return copy;
+    }
+
+    namespace
+    {
+        // serializes a whole tree into one growing buffer, when a sink is
+        // given the buffer is handed over to it every time it fills up
+        class writer
+        {
+            std::string &buffer;
+            const print_options &options;
+            void (*sink)(void *, const char *, size_t) = nullptr;
+            void *context = nullptr;
+
+            static constexpr size_t chunk = 1 << 16;
+
+        public:
+            void newline(int depth)
+            {
+                if (options.indent < 0)
+                    return;
+                buffer += '\n';
+                buffer.append(size_t(depth) * size_t(options.indent), ' ');
+            }
+
+            void separator()
+            {
+                buffer += ',';
+                if (options.indent < 0 && !options.compact)
+                    buffer += ' ';
+            }
+
+            void colon()
+            {
+                buffer += ':';
+                if (!options.compact)
+                    buffer += ' ';
+            }
+
+            void number(const json &j)
+            {
+                char digits[32];
+                std::to_chars_result result;
+                if (!j.isInteger())
+                {
+                    double value = j.get<double>();
+                    // json has no way to write these
+                    if (!std::isfinite(value))
+                    {
+                        buffer.append("null", 4);
+                        return;
+                    }
+                    result = std::to_chars(digits, digits + sizeof(digits), value);
+                }
+                else if (j.get<double>() < 0)
+                    result = std::to_chars(digits, digits + sizeof(digits), j.get<long long>());
+                else
+                    result = std::to_chars(digits, digits + sizeof(digits), j.get<unsigned long long>());
+                buffer.append(digits, result.ptr);
+            }
+
+            void quoted(std::string_view s)
+            {
+                appendQuoted(buffer, s);
+            }
+
+            writer(std::string &out, const print_options &o) : buffer(out), options(o) {}
+
+            writer(std::string &out, const print_options &o, void (*s)(void *, const char *, size_t), void *c)
+                : buffer(out), options(o), sink(s), context(c)
+            {
+                buffer.reserve(chunk + chunk / 4);
+            }
+
+            void flush()
+            {
+                if (sink && !buffer.empty())
+                {
+                    stats::wrote(buffer.size());
+                    sink(context, buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            }
+
+            // writes the value and everything in it in a loop over a stack
+            // of the containers still open, depth only costs heap memory
+            void write(const json &root, int depth = 0)
+            {
+                struct frame
+                {
+                    bool object;
+                    member_cursor members;
+                    const json *elements;
+                    size_t index;
+                    size_t count;
+                };
+                std::vector<frame> open;
+                const json *j = &root;
+                while (true)
+                {
+                    if (sink && buffer.size() >= chunk)
+                        flush();
+                    switch (j->getType())
+                    {
+                    case nullType:
+                        buffer.append("null", 4);
+                        break;
+                    case booleanType:
+                        if (j->get<bool>())
+                            buffer.append("true", 4);
+                        else
+                            buffer.append("false", 5);
+                        break;
+                    case numberType:
+                        number(*j);
+                        break;
+                    case stringType:
+                        quoted(node_access::string(*j));
+                        break;
+                    case objectType:
+                        buffer += '{';
+                        if (node_access::memberCount(*j) == 0)
+                        {
+                            buffer += '}';
+                            break;
+                        }
+                        open.push_back(frame{true, node_access::members(*j), nullptr, 0, 0});
+                        newline(depth + int(open.size()));
+                        quoted(open.back().members.key());
+                        colon();
+                        j = &open.back().members.value();
+                        continue;
+                    case collectionType:
+                    {
+                        auto [array, count] = node_access::elements(*j);
+                        buffer += '[';
+                        if (count == 0)
+                        {
+                            buffer += ']';
+                            break;
+                        }
+                        open.push_back(frame{false, member_cursor(), array, 0, count});
+                        newline(depth + int(open.size()));
+                        j = array;
+                        continue;
+                    }
+                    }
+                    // a value is done, go on with the next member or element
+                    // of the innermost container or close it
+                    j = nullptr;
+                    while (!open.empty() && !j)
+                    {
+                        frame &f = open.back();
+                        if (f.object)
+                        {
+                            f.members.next();
+                            if (!f.members.atEnd())
+                            {
+                                separator();
+                                newline(depth + int(open.size()));
+                                quoted(f.members.key());
+                                colon();
+                                j = &f.members.value();
+                                continue;
+                            }
+                        }
+                        else if (++f.index < f.count)
+                        {
+                            separator();
+                            newline(depth + int(open.size()));
+                            j = f.elements + f.index;
+                            continue;
+                        }
+                        newline(depth + int(open.size()) - 1);
+                        buffer += f.object ? '}' : ']';
+                        open.pop_back();
+                    }
+                    if (!j)
+                        return;
+                }
+            }
+        };
+
+        void toStream(void *context, const char *data, size_t size)
+        {
+            static_cast<std::ostream *>(context)->write(data, std::streamsize(size));
+        }
+
+        void toFile(void *context, const char *data, size_t size)
+        {
+            if (std::fwrite(data, 1, size, static_cast<std::FILE *>(context)) != size)
+                throw json::write_error("cannot write json output");
+        }
+
+        void toDescriptor(void *context, const char *data, size_t size)
+        {
+            int fd = *static_cast<int *>(context);
+            while (size > 0)
+            {
+#ifdef _WIN32
+                int written = _write(fd, data, unsigned(size > INT_MAX ? INT_MAX : size));
+#else
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0 && errno == EINTR)
+                    continue;
+#endif
+                if (written < 0)
+                    throw json::write_error("cannot write json output");
+                data += written;
+                size -= size_t(written);
+            }
+        }
+    }
+
+    std::string print(const json &j, const print_options &options)
+    {
+        stats::scope recording(phase::printing);
+        std::string out;
+        writer(out, options).write(j);
+        stats::wrote(out.size());
+        return out;
+    }
+
+    std::string print(const json &j)
+    {
+        return print(j, print_options());
+    }
+
+    void print(const json &j, std::ostream &os, const print_options &options)
+    {
+        stats::scope recording(phase::printing);
+        std::string buffer;
+        writer w(buffer, options, toStream, &os);
+        w.write(j);
+        w.flush();
+    }
+
+    void print(const json &j, std::FILE *file, const print_options &options)
+    {
+        stats::scope recording(phase::printing);
+        std::string buffer;
+        writer w(buffer, options, toFile, file);
+        w.write(j);
+        w.flush();
+    }
+
+    void printDescriptor(const json &j, int fd, const print_options &options)
+    {
+        stats::scope recording(phase::printing);
+        std::string buffer;
+        writer w(buffer, options, toDescriptor, &fd);
+        w.write(j);
+        w.flush();
+    }
+
+    void printFile(const json &j, const std::string &filePath, const print_options &options)
+    {
+        stats::scope recording(phase::printing);
+        std::FILE *file = std::fopen(filePath.c_str(), "wb");
+        if (!file)
+            throw json::write_error("cannot open file : " + filePath);
+        try
+        {
+            print(j, file, options);
+        }
+        catch (...)
+        {
+            std::fclose(file);
+            throw;
+        }
+        if (std::fclose(file) != 0)
+            throw json::write_error("cannot write file : " + filePath);
+    }
+
+    void printFile(const json &j, const std::string &filePath)
+    {
+        printFile(j, filePath, print_options());
+    }
+
+    std::ostream &operator<<(std::ostream &os, const json &j)
+    {
+        print(j, os, print_options());
+        return os;
+    }
+
+    namespace
+    {
+        const char *skipWhitespace(const char *p, const char *end)
+        {
+            while (p != end && isWhitespace(*p))
+                ++p;
+            return p;
+        }
+
+        // p is just past the opening quote, returns the closing one
+        const char *findClosingQuote(const char *p, const char *end, unsigned &content)
+        {
+            const char *quote = findStringEnd(p, end, content);
+            if (quote == end)
+                throw json::read_error("invalid json input : unterminated string");
+            return quote;
+        }
+
+        // p is just past the opening quote, returns just past the closing one
+        const char *skipString(const char *p, const char *end)
+        {
+            unsigned content = 0;
+            return findClosingQuote(p, end, content) + 1;
+        }
+
+        // containers are skipped by counting brackets outside of strings,
+        // nothing in between is checked
+        const char *skipValue(const char *p, const char *end)
+        {
+            // only quotes and brackets matter inside a container
+            static const auto interesting = []
+            {
+                std::array<bool, 256> table{};
+                for (unsigned char c : {'"', '{', '}', '[', ']'})
+                    table[c] = true;
+                return table;
+            }();
+            size_t depth = 0;
+            do
+            {
+                if (depth)
+                    while (p != end && !interesting[static_cast<unsigned char>(*p)])
+                        ++p;
+                if (p == end)
+                    throw json::read_error("invalid json input : unexpected end of input");
+                char c = *p++;
+                if (c == '"')
+                    p = skipString(p, end);
+                else if (c == '{' || c == '[')
+                    ++depth;
+                else if (c == '}' || c == ']')
+                {
+                    if (depth == 0)
+                        throw json::read_error("invalid json input : type not found");
+                    --depth;
+                }
+                else if (depth == 0)
+                    while (p != end && !isWhitespace(*p) && *p != ',' && *p != '}' && *p != ']')
+                        ++p;
+            } while (depth);
+            return p;
+        }
+
+        // moves past the comma after an entry, false at the closing bracket
+        bool nextEntry(const char *&p, const char *end, char close, const char *problem)
+        {
+            p = skipWhitespace(p, end);
+            if (p != end && *p == ',')
+            {
+                ++p;
+                return true;
+            }
+            if (p != end && *p == close)
+                return false;
+            throw json::read_error(problem);
+        }
+
+        // calls f with each key and a pointer to its value until f returns
+        // true, returns whether it did
+        template <typename F>
+        bool findEntry(const char *p, const char *end, F f)
+        {
+            p = skipWhitespace(p + 1, end);
+            if (p != end && *p == '}')
+                return false;
+            // keys with escapes are decoded to be compared
+            std::string decoded;
+            do
+            {
+                p = skipWhitespace(p, end);
+                if (p == end || *p != '"')
+                    throw json::read_error("invalid json input : object error");
+                const char *key = p + 1;
+                unsigned content = 0;
+                p = findClosingQuote(key, end, content) + 1;
+                std::string_view name = decodeString(key, p - 1 - key, content, [&](size_t size)
+                                                     { decoded.resize(size); return decoded.data(); });
+                p = skipWhitespace(p, end);
+                if (p == end || *p != ':')
+                    throw json::read_error("invalid json input : object error");
+                p = skipWhitespace(p + 1, end);
+                if (f(name, p))
+                    return true;
+                p = skipValue(p, end);
+            } while (nextEntry(p, end, '}', "invalid json input : object error"));
+            return false;
+        }
+        // runs work(i) for every i below count on up to threads threads,
+        // the calling one included, and rethrows the first exception
+        template <typename F>
+        void forEachParallel(size_t count, unsigned threads, F work)
+        {
+            std::atomic<size_t> next{0};
+            std::exception_ptr failure;
+            std::atomic<bool> failed{false};
+            statistics *counting = stats::shared();
+            auto loop = [&]
+            {
+                stats::share sharing(counting);
+                try
+                {
+                    for (size_t i; !failed && (i = next++) < count;)
+                        work(i);
+                }
+                catch (...)
+                {
+                    if (!failed.exchange(true))
+                        failure = std::current_exception();
+                }
+            };
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            std::vector<std::thread> pool;
+            for (unsigned t = 1; t < threads && t < count; ++t)
+                pool.emplace_back(loop);
+            loop();
+            for (std::thread &t : pool)
+                t.join();
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+
+        // cuts a large top level collection between its elements, parses
+        // the slices on several threads and moves the pieces together. false
+        // when the input is no such collection or has an error, the serial
+        // parse then runs and reports it as usual
+        bool parseSlices(const char *data, size_t size, const parse_options &options, json &result)
+        {
+            const char *end = data + size, *p = skipWhitespace(data, end);
+            if (p == end || *p != '[')
+                return false;
+            unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+            if (threads == 1)
+                return false;
+            size_t target = size / (size_t(threads) * 4) + 1;
+            // a quick pass that only matches brackets and skips strings finds
+            // where each element starts
+            std::vector<const char *> cuts{p + 1};
+            const char *closing;
+            try
+            {
+                p = skipWhitespace(p + 1, end);
+                if (p == end || *p == ']')
+                    return false;
+                const char *nextCut = p + target;
+                while (true)
+                {
+                    p = skipValue(p, end);
+                    if (!nextEntry(p, end, ']', "invalid json input : collection error"))
+                        break;
+                    if (p >= nextCut)
+                    {
+                        cuts.push_back(p);
+                        nextCut = p + target;
+                    }
+                    p = skipWhitespace(p, end);
+                }
+                closing = p;
+                if (skipWhitespace(closing + 1, end) != end || cuts.size() < 2)
+                    return false;
+            }
+            catch (const json::read_error &)
+            {
+                return false;
+            }
+            std::vector<json> pieces(cuts.size());
+            try
+            {
+                forEachParallel(cuts.size(), threads, [&](size_t i)
+                                {
+                                    // each slice stops before the comma that starts the next
+                                    const char *last = i + 1 < cuts.size() ? cuts[i + 1] - 1 : closing;
+                                    dom_builder builder{options};
+                                    parser<dom_builder> slice(cuts[i], last - cuts[i], builder, options.maxDepth);
+                                    slice.parseElements();
+                                    pieces[i] = builder.result(); });
+            }
+            catch (const json::read_error &)
+            {
+                return false;
+            }
+            auto *elements = new counted<std::vector<json>>();
+            size_t total = 0;
+            for (json &piece : pieces)
+                total += piece.get<std::vector<json>>().size();
+            elements->reserve(total);
+            for (json &piece : pieces)
+            {
+                std::vector<json> &part = piece.get<std::vector<json>>();
+                std::move(part.begin(), part.end(), std::back_inserter(*elements));
+            }
+            result = node_access::ownedCollection(elements);
+            stats::node(collectionType);
+            return true;
+        }
+    }
+
+    lazy_json::lazy_json(const char *position, const char *last) : current(skipWhitespace(position, last)), end(last) {}
+
+    lazy_json::lazy_json(std::string_view input) : lazy_json(input.data(), input.data() + input.size()) {}
+
+    lazy_json::lazy_json(const char *data, size_t size) : lazy_json(data, data + size) {}
+
+    type lazy_json::getType() const
+    {
+        if (current == end)
+            throw json::read_error("invalid json input : unexpected end of input");
+        switch (*current)
+        {
+        case 'n':
+            return nullType;
+        case 't':
+        case 'f':
+            return booleanType;
+        case '"':
+            return stringType;
+        case '{':
+            return objectType;
+        case '[':
+            return collectionType;
+        default:
+            if (isdigit(static_cast<unsigned char>(*current)) || *current == '-')
+                return numberType;
+            throw json::read_error("invalid json input : type not found");
+        }
+    }
+
+    std::string lazy_json::getTypeString() const
+    {
+        switch (getType())
+        {
+        case nullType:
+            return "null";
+        case booleanType:
+            return "boolean";
+        case numberType:
+            return "number";
+        case stringType:
+            return "string";
+        case objectType:
+            return "object";
+        case collectionType:
+            return "collection";
+        }
+        return "null";
+    }
+
+    json lazy_json::value() const
+    {
+        dom_builder builder{parse_options()};
+        parser<dom_builder> p(current, end - current, builder);
+        p.parseValue();
+        return builder.result();
+    }
+
+    std::string_view lazy_json::getStringView() const
+    {
+        if (getType() != stringType)
+            throw json::type_error("json value is not a string, type is : \'" + getTypeString() + "\'");
+        const char *closing = skipString(current + 1, end);
+        return std::string_view(current + 1, closing - 1 - (current + 1));
+    }
+
+    std::string_view lazy_json::getText() const
+    {
+        return std::string_view(current, skipValue(current, end) - current);
+    }
+
+    lazy_json lazy_json::operator[](std::string_view key) const
+    {
+        if (getType() != objectType)
+            throw json::type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        const char *found = nullptr;
+        if (!findEntry(current, end, [&](std::string_view name, const char *p)
+                       { found = p; return name == key; }))
+            throw std::out_of_range("no member named : " + std::string(key));
+        return lazy_json(found, end);
+    }
+
+    lazy_json lazy_json::operator[](int index) const
+    {
+        if (getType() != collectionType)
+            throw json::type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
+        if (index < 0)
+            throw std::out_of_range("index is out of range");
+        const char *p = skipWhitespace(current + 1, end);
+        if (p != end && *p == ']')
+            throw std::out_of_range("index is out of range");
+        for (int i = 0; i < index; ++i)
+        {
+            p = skipValue(skipWhitespace(p, end), end);
+            if (!nextEntry(p, end, ']', "invalid json input : collection error"))
+                throw std::out_of_range("index is out of range");
+        }
+        return lazy_json(p, end);
+    }
+
+    bool lazy_json::contains(std::string_view key) const
+    {
+        if (getType() != objectType)
+            throw json::type_error("json value is not a object, type is : \'" + getTypeString() + "\'");
+        return findEntry(current, end, [&](std::string_view name, const char *)
+                         { return name == key; });
+    }
+
+    size_t lazy_json::size() const
+    {
+        type t = getType();
+        if (t == objectType)
+        {
+            size_t count = 0;
+            findEntry(current, end, [&](std::string_view, const char *)
+                      { ++count; return false; });
+            return count;
+        }
+        if (t != collectionType)
+            throw json::type_error("json value is not a collection, type is : \'" + getTypeString() + "\'");
+        const char *p = skipWhitespace(current + 1, end);
+        if (p != end && *p == ']')
+            return 0;
+        size_t count = 1;
+        for (p = skipValue(p, end); nextEntry(p, end, ']', "invalid json input : collection error"); p = skipValue(skipWhitespace(p, end), end))
+            ++count;
+        return count;
+    }
+
+    namespace
+    {
+        // keeps the number the parser read, as the parser read it
+        struct number_sink
+        {
+            enum
+            {
+                real,
+                integer,
+                unsignedInteger
+            } kind = real;
+            union
+            {
+                double dataForNum;
+                long long dataForInt;
+                unsigned long long dataForUInt;
+            };
+
+            void onInteger(long long number)
+            {
+                kind = integer;
+                dataForInt = number;
+            }
+
+            void onUnsigned(unsigned long long number)
+            {
+                kind = unsignedInteger;
+                dataForUInt = number;
+            }
+
+            void onNumber(double number)
+            {
+                kind = real;
+                dataForNum = number;
+            }
+        };
+
+        bool opensAs(char c, type t)
+        {
+            switch (t)
+            {
+            case nullType:
+                return c == 'n';
+            case booleanType:
+                return c == 't' || c == 'f';
+            case numberType:
+                return isdigit(static_cast<unsigned char>(c)) || c == '-';
+            case stringType:
+                return c == '"';
+            case objectType:
+                return c == '{';
+            case collectionType:
+                return c == '[';
+            }
+            return false;
+        }
+
+        // checks a value without keeping anything of it
+        struct skip_sink
+        {
+            void onNull() {}
+            void onBool(bool) {}
+            void onInteger(long long) {}
+            void onUnsigned(unsigned long long) {}
+            void onNumber(double) {}
+            void onString(std::string_view) {}
+            void onKey(std::string_view) {}
+            void onStartObject() {}
+            void onEndObject() {}
+            void onStartArray() {}
+            void onEndArray() {}
+        };
+    }
+
+    token_reader::token_reader(std::string_view text, const parse_options &options) : token_reader(text.data(), text.size(), options) {}
+
+    token_reader::token_reader(const char *data, size_t size, const parse_options &options) : current(data), end(data + size), maxDepth(options.maxDepth) {}
+
+    type token_reader::peekType()
+    {
+        current = skipWhitespace(current, end);
+        return lazy_json(current, size_t(end - current)).getType();
+    }
+
+    void token_reader::expect(type t, const char *name)
+    {
+        current = skipWhitespace(current, end);
+        if (current == end || !opensAs(*current, t))
+            throw json::type_error(std::string("json value is not ") + name + ", type is : \'" + lazy_json(current, size_t(end - current)).getTypeString() + "\'");
+    }
+
+    // past the comma before the next entry, or the closing bracket
+    bool token_reader::advance(char closing, const char *problem)
+    {
+        current = skipWhitespace(current, end);
+        if (current == end)
+            throw json::read_error("invalid json input : unexpected end of input");
+        bool first = opened;
+        opened = false;
+        if (*current == closing)
+        {
+            ++current;
+            --depth;
+            return false;
+        }
+        if (!first)
+        {
+            if (*current != ',')
+                throw json::read_error(problem);
+            ++current;
+        }
+        return true;
+    }
+
+    void token_reader::readNull()
+    {
+        expect(nullType, "null");
+        skipValue();
+    }
+
+    bool token_reader::readBool()
+    {
+        expect(booleanType, "a boolean");
+        bool value = *current == 't';
+        skipValue();
+        return value;
+    }
+
+    namespace
+    {
+        number_sink readNumberAt(const char *&current, const char *end)
+        {
+            number_sink sink;
+            parser<number_sink> p(current, end - current, sink);
+            p.parseNumber();
+            current += p.consumed();
+            return sink;
+        }
+    }
+
+    json token_reader::readNumber()
+    {
+        expect(numberType, "a number");
+        number_sink number = readNumberAt(current, end);
+        switch (number.kind)
+        {
+        case number_sink::integer:
+            return json(number.dataForInt);
+        case number_sink::unsignedInteger:
+            return json(number.dataForUInt);
+        default:
+            return json(number.dataForNum);
+        }
+    }
+
+    // the same conversions as get on a parsed number, without the node
+    long long token_reader::readInteger()
+    {
+        expect(numberType, "a number");
+        number_sink number = readNumberAt(current, end);
+        if (number.kind == number_sink::integer)
+            return number.dataForInt;
+        if (number.kind == number_sink::real && fitsSigned(number.dataForNum))
+            return static_cast<long long>(number.dataForNum);
+        throw json::type_error("json number does not fit a long long");
+    }
+
+    unsigned long long token_reader::readUnsigned()
+    {
+        expect(numberType, "a number");
+        number_sink number = readNumberAt(current, end);
+        if (number.kind == number_sink::unsignedInteger)
+            return number.dataForUInt;
+        if (number.kind == number_sink::integer && number.dataForInt >= 0)
+            return static_cast<unsigned long long>(number.dataForInt);
+        if (number.kind == number_sink::real && fitsUnsigned(number.dataForNum))
+            return static_cast<unsigned long long>(number.dataForNum);
+        throw json::type_error("json number does not fit an unsigned long long");
+    }
+
+    double token_reader::readDouble()
+    {
+        expect(numberType, "a number");
+        number_sink number = readNumberAt(current, end);
+        switch (number.kind)
+        {
+        case number_sink::integer:
+            return static_cast<double>(number.dataForInt);
+        case number_sink::unsignedInteger:
+            return static_cast<double>(number.dataForUInt);
+        default:
+            return number.dataForNum;
+        }
+    }
+
+    std::string_view token_reader::readString()
+    {
+        expect(stringType, "a string");
+        const char *start = current + 1;
+        unsigned content = 0;
+        current = findClosingQuote(start, end, content) + 1;
+        return decodeString(start, current - 1 - start, content, [&](size_t size)
+                            { decoded.resize(size); return decoded.data(); });
+    }
+
+    json token_reader::readValue()
+    {
+        dom_builder builder{parse_options()};
+        parser<dom_builder> p(current, end - current, builder, maxDepth - depth);
+        p.parseValue();
+        current += p.consumed();
+        return builder.result();
+    }
+
+    void token_reader::skipValue()
+    {
+        skip_sink sink;
+        parser<skip_sink> p(current, end - current, sink, maxDepth - depth);
+        p.parseValue();
+        current += p.consumed();
+    }
+
+    void token_reader::beginObject()
+    {
+        expect(objectType, "a object");
+        if (depth == maxDepth)
+            throw json::read_error("invalid json input : nesting deeper than the maximum depth");
+        ++current;
+        ++depth;
+        opened = true;
+    }
+
+    bool token_reader::nextKey(std::string_view &key)
+    {
+        if (!advance('}', "invalid json input : object error"))
+            return false;
+        current = skipWhitespace(current, end);
+        if (current == end || *current != '"')
+            throw json::read_error("invalid json input : object error");
+        key = readString();
+        current = skipWhitespace(current, end);
+        if (current == end || *current != ':')
+            throw json::read_error("invalid json input : object error");
+        ++current;
+        return true;
+    }
+
+    void token_reader::beginCollection()
+    {
+        expect(collectionType, "a collection");
+        if (depth == maxDepth)
+            throw json::read_error("invalid json input : nesting deeper than the maximum depth");
+        ++current;
+        ++depth;
+        opened = true;
+    }
+
+    bool token_reader::nextElement()
+    {
+        return advance(']', "invalid json input : collection error");
+    }
+
+    void token_reader::finish()
+    {
+        if (skipWhitespace(current, end) != end)
+            throw json::read_error("invalid json input : unexpected trailing characters");
+    }
+
+    token_writer::token_writer(std::string &out, const print_options &o) : buffer(out), options(o) {}
+
+    // the separator and line break in front of an element, none after a key
+    void token_writer::prefix()
+    {
+        if (afterKey)
+        {
+            afterKey = false;
+            return;
+        }
+        if (depth == 0)
+            return;
+        writer w(buffer, options);
+        if (afterValue)
+            w.separator();
+        w.newline(depth);
+    }
+
+    void token_writer::writeNull()
+    {
+        writeValue(json());
+    }
+
+    void token_writer::writeBool(bool value)
+    {
+        writeValue(json(value));
+    }
+
+    void token_writer::writeInteger(long long value)
+    {
+        writeValue(json(value));
+    }
+
+    void token_writer::writeUnsigned(unsigned long long value)
+    {
+        writeValue(json(value));
+    }
+
+    void token_writer::writeNumber(double value)
+    {
+        writeValue(json(value));
+    }
+
+    void token_writer::writeString(std::string_view s)
+    {
+        prefix();
+        writer(buffer, options).quoted(s);
+        afterValue = true;
+    }
+
+    void token_writer::writeValue(const json &j)
+    {
+        prefix();
+        writer(buffer, options).write(j, depth);
+        afterValue = true;
+    }
+
+    void token_writer::beginObject()
+    {
+        prefix();
+        buffer += '{';
+        ++depth;
+        afterValue = false;
+    }
+
+    void token_writer::key(std::string_view k)
+    {
+        writer w(buffer, options);
+        if (afterValue)
+            w.separator();
+        w.newline(depth);
+        w.quoted(k);
+        w.colon();
+        afterKey = true;
+    }
+
+    void token_writer::endObject()
+    {
+        --depth;
+        if (afterValue)
+            writer(buffer, options).newline(depth);
+        buffer += '}';
+        afterValue = true;
+    }
+
+    void token_writer::beginCollection()
+    {
+        prefix();
+        buffer += '[';
+        ++depth;
+        afterValue = false;
+    }
+
+    void token_writer::endCollection()
+    {
+        --depth;
+        if (afterValue)
+            writer(buffer, options).newline(depth);
+        buffer += ']';
+        afterValue = true;
+    }
+
+    json parse(const char *data, size_t size, const parse_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(size);
+        json sliced;
+        if (options.threads != 1 && !options.resource && size >= options.parallelThreshold && parseSlices(data, size, options, sliced))
+            return sliced;
+        dom_builder builder(options);
+        run(data, size, options, builder);
+        return builder.result();
+    }
+
+    void parse(const char *data, size_t size, sax_handler &handler)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(size);
+        run(data, size, parse_options(), handler);
+    }
+
+    void parse(std::string_view input, sax_handler &handler)
+    {
+        parse(input.data(), input.size(), handler);
+    }
+
+    json parse(const char *data, size_t size)
+    {
+        return parse(data, size, parse_options());
+    }
+
+    json parse(std::string_view input, const parse_options &options)
+    {
+        return parse(input.data(), input.size(), options);
+    }
+
+    json parse(std::string_view input, std::pmr::memory_resource &resource)
+    {
+        parse_options options;
+        options.resource = &resource;
+        return parse(input.data(), input.size(), options);
+    }
+
+    json parse(std::string_view input)
+    {
+        return parse(input.data(), input.size(), parse_options());
+    }
+
+    json parseFile(std::string filePath)
+    {
+        return parseFile(filePath, parse_options());
+    }
+
+    namespace
+    {
+        std::unique_ptr<mapped_file> mapFile(const std::string &filePath)
+        {
+            try
+            {
+                return std::make_unique<mapped_file>(filePath);
+            }
+            catch (const json::read_error &)
+            {
+                // pipes and other files that cannot be mapped are read instead
+                return nullptr;
+            }
+        }
+
+        std::string readFile(const std::string &filePath)
+        {
+            std::ifstream is(filePath, std::ios::binary);
+            if (!is)
+                throw json::read_error("cannot open file : " + filePath);
+            return std::string{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+        }
+    }
+
+    json parseFile(std::string filePath, const parse_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        parse_options copying = options;
+        copying.borrowInput = false;
+        if (std::unique_ptr<mapped_file> mapping = mapFile(filePath))
+            return parse(mapping->data(), mapping->size(), copying);
+        std::string buffer = readFile(filePath);
+        return parse(buffer.data(), buffer.size(), copying);
+    }
+
+    void parseFile(std::string filePath, sax_handler &handler)
+    {
+        stats::scope recording(phase::parsing);
+        // a mapped file is only cached by the system, memory stays flat
+        // however large the file is
+        if (std::unique_ptr<mapped_file> mapping = mapFile(filePath))
+            return parse(mapping->data(), mapping->size(), handler);
+        std::string buffer = readFile(filePath);
+        parse(buffer.data(), buffer.size(), handler);
+    }
+
+    json parseFile(std::string filePath, arena &resource)
+    {
+        stats::scope recording(phase::parsing);
+        parse_options options;
+        options.resource = &resource;
+        std::shared_ptr<mapped_file> mapping = mapFile(filePath);
+        if (!mapping)
+            return parseFile(filePath, options);
+        // strings point straight into the mapping, the arena keeps it open
+        resource.keepAlive(mapping);
+        options.borrowInput = true;
+        return parse(mapping->data(), mapping->size(), options);
+    }
+
+    namespace
+    {
+        // records of one chunk of lines, line numbers counted from the chunk
+        struct line_chunk
+        {
+            const char *begin = nullptr;
+            const char *end = nullptr;
+            size_t lineCount = 0;
+            std::vector<json> values = {};
+            std::vector<size_t> lines = {};
+            std::vector<line_error> errors = {};
+        };
+
+        // cuts the input into chunks of about chunkSize that end on a newline
+        std::vector<line_chunk> splitLines(std::string_view input, size_t chunkSize)
+        {
+            std::vector<line_chunk> chunks;
+            const char *p = input.data(), *end = input.data() + input.size();
+            while (p != end)
+            {
+                const char *cut = size_t(end - p) > chunkSize ? p + chunkSize : end;
+                if (cut != end)
+                {
+                    const char *newline = static_cast<const char *>(std::memchr(cut, '\n', end - cut));
+                    cut = newline ? newline + 1 : end;
+                }
+                chunks.push_back(line_chunk{p, cut});
+                p = cut;
+            }
+            return chunks;
+        }
+
+        void parseChunk(line_chunk &chunk, const line_options &lineOptions)
+        {
+            // one builder for the whole chunk keeps its stacks allocated
+            parse_options options;
+            options.keys = lineOptions.keys;
+            options.maxDepth = lineOptions.maxDepth;
+            dom_builder builder{options};
+            const char *p = chunk.begin;
+            while (p != chunk.end)
+            {
+                const char *newline = static_cast<const char *>(std::memchr(p, '\n', chunk.end - p));
+                const char *lineEnd = newline ? newline : chunk.end;
+                ++chunk.lineCount;
+                parser<dom_builder> lineParser(p, lineEnd - p, builder, options.maxDepth);
+                if (!lineParser.atEnd())
+                {
+                    try
+                    {
+                        lineParser.parseValue();
+                        if (!lineParser.atEnd())
+                            throw json::read_error("invalid json input : unexpected trailing characters");
+                        chunk.values.push_back(builder.result());
+                        chunk.lines.push_back(chunk.lineCount);
+                    }
+                    catch (const json::read_error &e)
+                    {
+                        builder.clear();
+                        chunk.values.emplace_back();
+                        chunk.lines.push_back(chunk.lineCount);
+                        chunk.errors.push_back(line_error{chunk.lineCount, e.what()});
+                    }
+                }
+                p = newline ? newline + 1 : chunk.end;
+            }
+        }
+    }
+
+    std::vector<json> parseLines(std::string_view input, std::vector<line_error> &errors, const line_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(input.size());
+        std::vector<line_chunk> chunks = splitLines(input, options.chunkSize);
+        forEachParallel(chunks.size(), options.threads, [&](size_t i)
+                        { parseChunk(chunks[i], options); });
+        size_t total = 0;
+        for (const line_chunk &chunk : chunks)
+            total += chunk.values.size();
+        std::vector<json> values;
+        values.reserve(total);
+        size_t lineBase = 0;
+        for (line_chunk &chunk : chunks)
+        {
+            std::move(chunk.values.begin(), chunk.values.end(), std::back_inserter(values));
+            for (line_error &error : chunk.errors)
+                errors.push_back(line_error{lineBase + error.line, std::move(error.problem)});
+            lineBase += chunk.lineCount;
+        }
+        return values;
+    }
+
+    void parseLines(std::string_view input, const std::function<void(size_t, json &&)> &onValue, std::vector<line_error> &errors, const line_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(input.size());
+        // chunks are parsed a window at a time so memory stays bounded,
+        // the window is handed over in order before the next one starts
+        std::vector<line_chunk> chunks = splitLines(input, options.chunkSize);
+        unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        size_t window = size_t(threads) * 4, lineBase = 0;
+        for (size_t first = 0; first < chunks.size(); first += window)
+        {
+            size_t count = std::min(window, chunks.size() - first);
+            forEachParallel(count, threads, [&](size_t i)
+                            { parseChunk(chunks[first + i], options); });
+            for (size_t i = first; i < first + count; ++i)
+            {
+                line_chunk &chunk = chunks[i];
+                size_t e = 0;
+                for (size_t v = 0; v < chunk.values.size(); ++v)
+                {
+                    // failed records are reported, not passed on
+                    if (e < chunk.errors.size() && chunk.errors[e].line == chunk.lines[v])
+                    {
+                        errors.push_back(line_error{lineBase + chunk.lines[v], std::move(chunk.errors[e++].problem)});
+                        continue;
+                    }
+                    onValue(lineBase + chunk.lines[v], std::move(chunk.values[v]));
+                }
+                lineBase += chunk.lineCount;
+                chunk = line_chunk{chunk.begin, chunk.end};
+            }
+        }
+    }
+
+    std::vector<json> parseLinesFile(std::string filePath, std::vector<line_error> &errors, const line_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        if (std::unique_ptr<mapped_file> mapping = mapFile(filePath))
+            return parseLines(std::string_view(mapping->data(), mapping->size()), errors, options);
+        std::string buffer = readFile(filePath);
+        return parseLines(buffer, errors, options);
+    }
+
+    void parseLinesFile(std::string filePath, const std::function<void(size_t, json &&)> &onValue, std::vector<line_error> &errors, const line_options &options)
+    {
+        stats::scope recording(phase::parsing);
+        if (std::unique_ptr<mapped_file> mapping = mapFile(filePath))
+            return parseLines(std::string_view(mapping->data(), mapping->size()), onValue, errors, options);
+        std::string buffer = readFile(filePath);
+        parseLines(buffer, onValue, errors, options);
+    }
+
+    std::istream &operator>>(std::istream &is, json &j)
+    {
+        j = parse(is);
+        return is;
+    }
+};
+
+void std::hash<badge881::json::json>::combine(size_t &hash, const size_t &other) const noexcept
+{
+    hash ^= other + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+}
+
+size_t std::hash<badge881::json::json>::operator()(const badge881::json::json &s) const noexcept
+{
+    using badge881::json::json;
+    using badge881::json::member_cursor;
+    using badge881::json::node_access;
+    // containers being hashed in document order, the hash of a finished
+    // child is folded into its parent as a call per level would have. the
+    // outermost one is kept aside so that flat containers need no heap
+    struct frame
+    {
+        const json *node;
+        size_t hash;
+        member_cursor members;
+        const json *elements;
+        size_t index;
+        size_t count;
+    };
+    auto start = [](frame &f, const json &j)
+    {
+        f.node = &j;
+        f.hash = 0;
+        f.index = 0;
+        if (j.isObject())
+        {
+            f.members = node_access::members(j);
+            f.count = node_access::memberCount(j);
+        }
+        else
+            std::tie(f.elements, f.count) = node_access::elements(j);
+    };
+    auto scalar = [](const json &j) -> size_t
+    {
+        if (j.isBoolean())
+            return std::hash<bool>{}(j.get<bool>());
+        if (j.isNumber())
+            return std::hash<double>{}(j.get<double>());
+        if (j.isString())
+            return std::hash<std::string_view>{}(node_access::string(j));
+        return 0;
+    };
+    if (!s.isObject() && !s.isCollection())
+        return scalar(s);
+    frame outermost;
+    std::vector<frame> open;
+    start(outermost, s);
+    while (true)
+    {
+        frame &f = open.empty() ? outermost : open.back();
+        if (f.index == f.count)
+        {
+            size_t hash = f.hash;
+            if (open.empty())
+                return hash;
+            open.pop_back();
+            frame &parent = open.empty() ? outermost : open.back();
+            if (parent.node->isObject())
+            {
+                // members are summed so that the order they are stored in does not matter
+                size_t member = std::hash<std::string_view>{}(parent.members.key());
+                combine(member, hash);
+                parent.hash += member;
+                parent.members.next();
+            }
+            else
+                combine(parent.hash, hash);
+            ++parent.index;
+            continue;
+        }
+        const json &child = f.node->isObject() ? f.members.value() : f.elements[f.index];
+        if (child.isObject() || child.isCollection())
+        {
+            start(open.emplace_back(), child);
+            continue;
+        }
+        if (f.node->isObject())
+        {
+            size_t member = std::hash<std::string_view>{}(f.members.key());
+            combine(member, scalar(child));
+            f.hash += member;
+            f.members.next();
+        }
+        else
+            combine(f.hash, scalar(child));
+        ++f.index;
+    }
+}
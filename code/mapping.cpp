@@ -0,0 +1,90 @@
+#include "mapping.h"
+#include "../include/json.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace badge881::json
+{
+#ifdef _WIN32
+    mapped_file::mapped_file(const std::string &path)
+    {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            file = nullptr;
+            throw json::read_error("cannot open file : " + path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            throw json::read_error("cannot read file : " + path);
+        }
+        length = size_t(size.QuadPart);
+        // an empty file cannot be mapped, it simply has no data
+        if (length == 0)
+            return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            address = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!address)
+        {
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            throw json::read_error("cannot map file : " + path);
+        }
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (address)
+            UnmapViewOfFile(address);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file)
+            CloseHandle(file);
+    }
+#else
+    mapped_file::mapped_file(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw json::read_error("cannot open file : " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            ::close(fd);
+            throw json::read_error("cannot map file : " + path);
+        }
+        length = size_t(info.st_size);
+        // an empty file cannot be mapped, it simply has no data
+        if (length > 0)
+        {
+            void *view = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (view == MAP_FAILED)
+            {
+                ::close(fd);
+                throw json::read_error("cannot map file : " + path);
+            }
+            ::madvise(view, length, MADV_SEQUENTIAL);
+            address = static_cast<const char *>(view);
+        }
+        // the mapping keeps the file alive on its own
+        ::close(fd);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (address)
+            ::munmap(const_cast<char *>(address), length);
+    }
+#endif
+}
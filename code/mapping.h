@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace badge881::json
+{
+    // read only view of a whole file through the page cache, processes
+    // mapping the same file share its pages
+    class mapped_file
+    {
+        const char *address = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        void *file = nullptr;
+        void *mapping = nullptr;
+#endif
+
+    public:
+        explicit mapped_file(const std::string &path);
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+        ~mapped_file();
+
+        const char *data() const
+        {
+            return address;
+        }
+
+        size_t size() const
+        {
+            return length;
+        }
+    };
+}
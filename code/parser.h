@@ -0,0 +1,589 @@
+#pragma once
+
+#include "../include/json.h"
+#include "structural.h"
+#include "strings.h"
+#include "internals.h"
+#include "stats.h"
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <memory_resource>
+
+// the tokenizer and the tree builder, shared by every part of the library
+// that reads json text
+namespace badge881::json
+{
+    inline bool isWhitespace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    // a number past the range of a double, its digits and exponent already
+    // checked. the decimal exponent of the first significant digit tells
+    // overflow, read as infinity, from underflow, read as zero
+    inline double outOfRange(const char *digits, const char *end, bool negative)
+    {
+        const char *p = digits;
+        long long magnitude = 0;
+        if (*p == '0')
+        {
+            ++p;
+            if (p != end && *p == '.')
+                while (++p != end && *p == '0')
+                    --magnitude;
+        }
+        else
+            while (p != end && isdigit(static_cast<unsigned char>(*p)))
+                ++p, ++magnitude;
+        while (p != end && *p != 'e' && *p != 'E')
+            ++p;
+        long long exponent = 0;
+        if (p != end)
+        {
+            bool below = *++p == '-';
+            if (*p == '+' || *p == '-')
+                ++p;
+            // saturates, far past what a double or the digits can make up
+            for (; p != end && isdigit(static_cast<unsigned char>(*p)); ++p)
+                exponent = std::min(exponent * 10 + (*p - '0'), 1LL << 40);
+            if (below)
+                exponent = -exponent;
+        }
+        double value = magnitude + exponent > 0 ? HUGE_VAL : 0.0;
+        return negative ? -value : value;
+    }
+
+    // one pass over a contiguous buffer, the whole document is
+    // walked with a raw pointer instead of per-character stream calls.
+    // given a structural index the parser jumps from token to token
+    // and from quote to quote instead of scanning the bytes in between.
+    // it builds nothing itself and reports what it reads to the handler
+    template <typename handler_type>
+    class parser
+    {
+        const char *begin;
+        const char *current;
+        const char *end;
+        const uint32_t *structural = nullptr;
+        const uint32_t *structuralEnd = nullptr;
+        handler_type &handler;
+        // one bit per open container, set for objects. the first levels
+        // sit in the parser itself, deeper ones on the heap
+        std::array<uint64_t, 4> shallow{};
+        std::vector<uint64_t> deep;
+        size_t depth = 0;
+        size_t maxDepth;
+        // the innermost open container is an object
+        bool object = false;
+        // decoded strings, a value only lives until the next one is read
+        // while keys stay for the whole parse. with a resource to keep
+        // them in they live as long as it does
+        std::string scratch;
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> keyText;
+        std::pmr::memory_resource *keep = nullptr;
+
+        char *decodingSpace(size_t size, bool key)
+        {
+            if (keep)
+            {
+                stats::allocated(size);
+                return static_cast<char *>(keep->allocate(size, 1));
+            }
+            if (key)
+            {
+                if (!keyText)
+                    keyText = std::make_unique<std::pmr::monotonic_buffer_resource>();
+                return static_cast<char *>(keyText->allocate(size, 1));
+            }
+            scratch.resize(size);
+            return scratch.data();
+        }
+
+        void open(bool isObject)
+        {
+            if (depth == maxDepth)
+                throw json::read_error("invalid json input : nesting deeper than the maximum depth");
+            size_t word = depth / 64;
+            if (word >= shallow.size() && word - shallow.size() == deep.size())
+                deep.push_back(0);
+            uint64_t &bits = word < shallow.size() ? shallow[word] : deep[word - shallow.size()];
+            uint64_t bit = uint64_t(1) << (depth % 64);
+            bits = isObject ? bits | bit : bits & ~bit;
+            object = isObject;
+            ++depth;
+            stats::enter();
+        }
+
+        void close()
+        {
+            --depth;
+            stats::leave();
+            if (depth)
+            {
+                size_t level = depth - 1, word = level / 64;
+                uint64_t bits = word < shallow.size() ? shallow[word] : deep[word - shallow.size()];
+                object = bits >> (level % 64) & 1;
+            }
+        }
+
+        // a key and its colon, up to the value
+        void parseKey()
+        {
+            skipWhitespace();
+            if (peek() != '"')
+                throw json::read_error("invalid json input : object error");
+            handler.onKey(parseString(true));
+            skipWhitespace();
+            if (peek() != ':')
+                throw json::read_error("invalid json input : object error");
+            ++current;
+        }
+
+        // moves to the first indexed position at or after offset
+        void seekStructural(size_t offset)
+        {
+            while (structural != structuralEnd && *structural < offset)
+                ++structural;
+            current = structural != structuralEnd ? begin + *structural : end;
+        }
+
+    public:
+        parser(const char *data, size_t size, handler_type &h, size_t depthLimit = parse_options().maxDepth)
+            : begin(data), current(data), end(data + size), handler(h), maxDepth(depthLimit) {}
+
+        parser(const char *data, size_t size, const std::vector<uint32_t> &index, handler_type &h, size_t depthLimit = parse_options().maxDepth)
+            : begin(data), current(data), end(data + size), structural(index.data()), structuralEnd(index.data() + index.size()), handler(h), maxDepth(depthLimit) {}
+
+        size_t consumed() const
+        {
+            return current - begin;
+        }
+
+        bool atEnd()
+        {
+            skipWhitespace();
+            return current == end;
+        }
+
+        void skipWhitespace()
+        {
+            if (structural)
+            {
+                // whitespace always runs up to the next indexed position
+                if (current != end && isWhitespace(*current))
+                    seekStructural(current - begin);
+                return;
+            }
+            while (current != end && isWhitespace(*current))
+                ++current;
+        }
+
+        char peek()
+        {
+            if (current == end)
+                throw json::read_error("invalid json input : unexpected end of input");
+            return *current;
+        }
+
+        void expectWord(const char *word, size_t size, const char *problem)
+        {
+            if (size_t(end - current) < size || std::memcmp(current, word, size) != 0)
+                throw json::read_error(problem);
+            current += size;
+        }
+
+        // decoded strings written to the resource live as long as it does,
+        // for a builder that borrows them
+        void keepDecoded(std::pmr::memory_resource &resource)
+        {
+            keep = &resource;
+        }
+
+        std::string_view parseString(bool key = false)
+        {
+            const char *start = ++current;
+            unsigned content = 0;
+            if (structural)
+            {
+                seekStructural(start - begin);
+                if (current != end)
+                    content = classifyString(start, current - start);
+            }
+            else
+                current = findStringEnd(start, end, content);
+            if (current == end)
+                throw json::read_error("invalid json input : unterminated string");
+            size_t size = current++ - start;
+            return decodeString(start, size, content, [&](size_t space)
+                                { return decodingSpace(space, key); });
+        }
+
+        void parseNumber()
+        {
+            // check the json number grammar in one pass, integers that
+            // fit 64 bits are read as such, everything else as a double
+            const char *start = current;
+            bool negative = current != end && *current == '-';
+            if (negative)
+                ++current;
+            const char *digits = current;
+            while (current != end && isdigit(static_cast<unsigned char>(*current)))
+                ++current;
+            if (current == digits || (*digits == '0' && current - digits > 1))
+                throw json::read_error("invalid json input : number error");
+            bool integer = true;
+            if (current != end && *current == '.')
+            {
+                integer = false;
+                const char *fraction = ++current;
+                while (current != end && isdigit(static_cast<unsigned char>(*current)))
+                    ++current;
+                if (current == fraction)
+                    throw json::read_error("invalid json input : number error");
+            }
+            if (current != end && (*current == 'e' || *current == 'E'))
+            {
+                integer = false;
+                ++current;
+                if (current != end && (*current == '+' || *current == '-'))
+                    ++current;
+                const char *exponent = current;
+                while (current != end && isdigit(static_cast<unsigned char>(*current)))
+                    ++current;
+                if (current == exponent)
+                    throw json::read_error("invalid json input : number error");
+            }
+            if (integer)
+            {
+                long long value;
+                if (std::from_chars(start, current, value).ec == std::errc())
+                {
+                    if (negative && value == 0)
+                        handler.onNumber(-0.0);
+                    else
+                        handler.onInteger(value);
+                    return;
+                }
+                unsigned long long uvalue;
+                if (!negative && std::from_chars(start, current, uvalue).ec == std::errc())
+                {
+                    handler.onUnsigned(uvalue);
+                    return;
+                }
+            }
+            double value;
+            std::errc error = std::from_chars(start, current, value).ec;
+            if (error == std::errc::result_out_of_range)
+                value = outOfRange(digits, current, negative);
+            else if (error != std::errc())
+                throw json::read_error("invalid json input : number error");
+            handler.onNumber(value);
+        }
+
+        // the comma separated elements of a slice cut out of a collection,
+        // reported as one collection
+        void parseElements()
+        {
+            open(false);
+            handler.onStartArray();
+            while (true)
+            {
+                parseValue();
+                if (atEnd())
+                    break;
+                if (*current++ != ',')
+                    throw json::read_error("invalid json input : collection error");
+            }
+            close();
+            handler.onEndArray();
+        }
+
+        // reads one value, containers included, in a loop over an explicit
+        // stack of the containers still open instead of a call per level
+        void parseValue()
+        {
+            size_t base = depth;
+            while (true)
+            {
+                skipWhitespace();
+                switch (peek())
+                {
+                case 'n':
+                    expectWord("null", 4, "invalid json input : null error");
+                    stats::node(nullType);
+                    handler.onNull();
+                    break;
+                case 't':
+                    expectWord("true", 4, "invalid json input : true error");
+                    stats::node(booleanType);
+                    handler.onBool(true);
+                    break;
+                case 'f':
+                    expectWord("false", 5, "invalid json input : false error");
+                    stats::node(booleanType);
+                    handler.onBool(false);
+                    break;
+                case '"':
+                    stats::node(stringType);
+                    handler.onString(parseString());
+                    break;
+                case '{':
+                    stats::node(objectType);
+                    open(true);
+                    handler.onStartObject();
+                    ++current;
+                    skipWhitespace();
+                    if (peek() != '}')
+                    {
+                        parseKey();
+                        continue;
+                    }
+                    ++current;
+                    close();
+                    handler.onEndObject();
+                    break;
+                case '[':
+                    stats::node(collectionType);
+                    open(false);
+                    handler.onStartArray();
+                    ++current;
+                    skipWhitespace();
+                    if (peek() != ']')
+                        continue;
+                    ++current;
+                    close();
+                    handler.onEndArray();
+                    break;
+                default:
+                    if (!isdigit(static_cast<unsigned char>(*current)) && *current != '-')
+                        throw json::read_error("invalid json input : type not found");
+                    stats::node(numberType);
+                    parseNumber();
+                }
+                // a value is done, go on with the next member or element of
+                // the innermost container or close it
+                bool another = false;
+                while (depth != base && !another)
+                {
+                    skipWhitespace();
+                    char next = peek();
+                    ++current;
+                    if (object)
+                    {
+                        if (next == ',')
+                        {
+                            parseKey();
+                            another = true;
+                        }
+                        else if (next == '}')
+                        {
+                            close();
+                            handler.onEndObject();
+                        }
+                        else
+                            throw json::read_error("invalid json input : object error");
+                    }
+                    else if (next == ',')
+                        another = true;
+                    else if (next == ']')
+                    {
+                        close();
+                        handler.onEndArray();
+                    }
+                    else
+                        throw json::read_error("invalid json input : collection error");
+                }
+                if (!another)
+                    return;
+            }
+        }
+    };
+
+    // turns the events back into a document. open containers keep their
+    // finished values and keys on shared stacks and are built in one
+    // piece when they close, with a resource they are moved into it
+    class dom_builder
+    {
+        std::pmr::memory_resource *resource;
+        bool borrowInput;
+        // with a key table every key on the stack is the text of an atom
+        key_table *table;
+        std::vector<json> values;
+        std::vector<std::string_view> keys;
+        // where each open container starts on the value and key stacks
+        std::vector<std::pair<size_t, size_t>> frames;
+        // atoms met lately, by hash, spare most trips to the shared table
+        std::array<const key_atom *, 256> recent{};
+
+        const key_atom *intern(std::string_view key)
+        {
+            uint32_t hash = member_key::hashOf(key);
+            const key_atom *&atom = recent[hash & 255];
+            if (!atom || atom->hash != hash || std::string_view(atom->text(), atom->size) != key)
+                atom = table->intern(key);
+            return atom;
+        }
+
+    public:
+        dom_builder(const parse_options &options) : resource(options.resource), borrowInput(options.borrowInput), table(options.keys) {}
+
+        json result()
+        {
+            json j = std::move(values.back());
+            values.pop_back();
+            return j;
+        }
+
+        // drops what a failed parse left behind so the builder can be reused
+        void clear()
+        {
+            values.clear();
+            keys.clear();
+            frames.clear();
+        }
+
+        void onNull()
+        {
+            values.emplace_back();
+        }
+
+        void onBool(bool value)
+        {
+            values.emplace_back(value);
+        }
+
+        void onInteger(long long value)
+        {
+            values.emplace_back(value);
+        }
+
+        void onUnsigned(unsigned long long value)
+        {
+            values.emplace_back(value);
+        }
+
+        void onNumber(double value)
+        {
+            values.emplace_back(value);
+        }
+
+        void onString(std::string_view s)
+        {
+            if (resource && borrowInput)
+                values.push_back(node_access::borrowedString(s.data(), s.size()));
+            else if (resource)
+                values.push_back(node_access::borrowedString(node_access::copyString(s, *resource), s.size()));
+            else
+                values.push_back(node_access::ownedString(s));
+        }
+
+        void onKey(std::string_view key)
+        {
+            if (table)
+            {
+                const key_atom *atom = intern(key);
+                key = std::string_view(atom->text(), atom->size);
+            }
+            else if (resource && !borrowInput)
+                key = std::string_view(node_access::copyString(key, *resource), key.size());
+            keys.push_back(key);
+        }
+
+        void onStartObject()
+        {
+            frames.emplace_back(values.size(), keys.size());
+        }
+
+        void onStartArray()
+        {
+            frames.emplace_back(values.size(), keys.size());
+        }
+
+        void onEndObject()
+        {
+            auto [valueBase, keyBase] = frames.back();
+            frames.pop_back();
+            size_t count = values.size() - valueBase;
+            json j;
+            if (resource)
+            {
+                borrowed_member *members = node_access::allocateMembers(count, *resource);
+                for (size_t i = 0; i < count; ++i)
+                    new (members + i) borrowed_member{keys[keyBase + i], std::move(values[valueBase + i])};
+                j = node_access::borrowedObject(members, node_access::removeDuplicates(members, count));
+            }
+            else
+            {
+                auto *obj = new counted<flat_object>();
+                obj->reserve(count);
+                if (count)
+                    stats::allocated(count * sizeof(flat_member));
+                for (size_t i = 0; i < count; ++i)
+                    if (table)
+                        obj->assign(member_key(reinterpret_cast<const key_atom *>(keys[keyBase + i].data()) - 1), std::move(values[valueBase + i]));
+                    else
+                        obj->assign(keys[keyBase + i], std::move(values[valueBase + i]));
+                j = node_access::ownedObject(obj);
+            }
+            keys.resize(keyBase);
+            values.resize(valueBase);
+            values.push_back(std::move(j));
+        }
+
+        void onEndArray()
+        {
+            size_t base = frames.back().first;
+            frames.pop_back();
+            size_t count = values.size() - base;
+            json j;
+            if (resource)
+            {
+                json *elements = node_access::allocateElements(count, *resource);
+                for (size_t i = 0; i < count; ++i)
+                    new (elements + i) json(std::move(values[base + i]));
+                j = node_access::borrowedCollection(elements, count);
+            }
+            else
+            {
+                auto *col = new counted<std::vector<json>>();
+                col->reserve(count);
+                if (count)
+                    stats::allocated(count * sizeof(json));
+                std::move(values.begin() + base, values.end(), std::back_inserter(*col));
+                j = node_access::ownedCollection(col);
+            }
+            values.resize(base);
+            values.push_back(std::move(j));
+        }
+    };
+
+    // sax_handler is reached through virtual calls, the builder inlined
+    template <typename handler_type>
+    void run(const char *data, size_t size, const parse_options &options, handler_type &handler)
+    {
+        if (options.structuralIndex && size >= options.structuralIndexThreshold && size < UINT32_MAX)
+        {
+            std::vector<uint32_t> index;
+            buildStructuralIndex(data, size, index);
+            parser<handler_type> p(data, size, index, handler, options.maxDepth);
+            if (options.resource && options.borrowInput)
+                p.keepDecoded(*options.resource);
+            p.parseValue();
+            if (!p.atEnd())
+                throw json::read_error("invalid json input : unexpected trailing characters");
+            return;
+        }
+        parser<handler_type> p(data, size, handler, options.maxDepth);
+        if (options.resource && options.borrowInput)
+            p.keepDecoded(*options.resource);
+        p.parseValue();
+        if (!p.atEnd())
+            throw json::read_error("invalid json input : unexpected trailing characters");
+    }
+}
@@ -0,0 +1,486 @@
+#include "../include/json.h"
+#include "parser.h"
+#include "strings.h"
+#include "stats.h"
+#include <stdexcept>
+#include <memory_resource>
+#include <algorithm>
+#include <istream>
+
+namespace badge881::json
+{
+    namespace
+    {
+        // the tree builder behind the handler interface of a push_parser
+        class building : public sax_handler
+        {
+            // the builder holds on to the keys of open objects, which
+            // outlive the piece they came in. kept until the document is
+            // taken, unless the builder copies them itself
+            std::pmr::monotonic_buffer_resource keyText;
+            bool copyKeys;
+
+        public:
+            dom_builder builder;
+
+            explicit building(const parse_options &options) : copyKeys(!options.keys && !options.resource), builder(options) {}
+
+            void clear()
+            {
+                builder.clear();
+                keyText.release();
+            }
+
+            void onNull() override { builder.onNull(); }
+            void onBool(bool value) override { builder.onBool(value); }
+            void onInteger(long long value) override { builder.onInteger(value); }
+            void onUnsigned(unsigned long long value) override { builder.onUnsigned(value); }
+            void onNumber(double value) override { builder.onNumber(value); }
+            void onString(std::string_view s) override { builder.onString(s); }
+            void onKey(std::string_view key) override
+            {
+                if (copyKeys)
+                    key = std::string_view(node_access::copyString(key, keyText), key.size());
+                builder.onKey(key);
+            }
+
+            void onStartObject() override { builder.onStartObject(); }
+            void onEndObject() override { builder.onEndObject(); }
+            void onStartArray() override { builder.onStartArray(); }
+            void onEndArray() override { builder.onEndArray(); }
+        };
+
+        parse_options copying(parse_options options)
+        {
+            options.borrowInput = false;
+            return options;
+        }
+
+        bool isNumberChar(char c)
+        {
+            return isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+        }
+    }
+
+    // the parser as a state machine : what it expects next, the containers
+    // still open and the token a piece ended in the middle of
+    struct push_parser::machine
+    {
+        enum expecting : unsigned char
+        {
+            value,
+            valueOrClose,
+            key,
+            keyOrClose,
+            colon,
+            commaOrClose,
+            nothing
+        };
+
+        enum partial : unsigned char
+        {
+            noToken,
+            stringToken,
+            keyToken,
+            numberToken,
+            wordToken
+        };
+
+        std::unique_ptr<building> built;
+        sax_handler &handler;
+        // '{' or '[' for each open container
+        std::vector<char> open;
+        expecting expect = value;
+        partial token = noToken;
+        // the last character of the piece was a backslash inside a string
+        bool escaped = false;
+        // what the string read so far holds, see strings.h
+        unsigned content = 0;
+        bool complete = false;
+        bool failed = false;
+        // feed returns as soon as the document is complete
+        bool stopAtEnd = false;
+        // the part of the current token read from earlier pieces
+        std::string pending;
+        // the current string with its escapes decoded
+        std::string decoded;
+        const char *word = nullptr;
+        size_t wordSize = 0;
+        size_t matched = 0;
+        size_t maxDepth;
+
+        explicit machine(const parse_options &options) : built(std::make_unique<building>(copying(options))), handler(*built), maxDepth(options.maxDepth) {}
+
+        machine(sax_handler &h, const parse_options &options) : handler(h), maxDepth(options.maxDepth) {}
+
+        [[noreturn]] void fail(const char *problem)
+        {
+            throw json::read_error(problem);
+        }
+
+        void push(char container)
+        {
+            if (open.size() == maxDepth)
+                fail("invalid json input : nesting deeper than the maximum depth");
+            open.push_back(container);
+            stats::enter();
+        }
+
+        void valueDone()
+        {
+            if (open.empty())
+            {
+                expect = nothing;
+                complete = true;
+            }
+            else
+                expect = commaOrClose;
+        }
+
+        void number(const char *data, size_t size)
+        {
+            parser<sax_handler> p(data, size, handler);
+            p.parseNumber();
+            if (p.consumed() != size)
+                fail("invalid json input : number error");
+        }
+
+        void close()
+        {
+            char top = open.back();
+            open.pop_back();
+            stats::leave();
+            if (top == '{')
+                handler.onEndObject();
+            else
+                handler.onEndArray();
+            valueDone();
+        }
+
+        void startWord(const char *w, size_t size)
+        {
+            stats::node(*w == 'n' ? nullType : booleanType);
+            token = wordToken;
+            word = w;
+            wordSize = size;
+            matched = 0;
+        }
+
+        // p is on the first character of a value
+        void startValue(const char *&p)
+        {
+            switch (*p)
+            {
+            case '"':
+                stats::node(stringType);
+                token = stringToken;
+                ++p;
+                return;
+            case '{':
+                stats::node(objectType);
+                push('{');
+                handler.onStartObject();
+                expect = keyOrClose;
+                ++p;
+                return;
+            case '[':
+                stats::node(collectionType);
+                push('[');
+                handler.onStartArray();
+                expect = valueOrClose;
+                ++p;
+                return;
+            case 'n':
+                return startWord("null", 4);
+            case 't':
+                return startWord("true", 4);
+            case 'f':
+                return startWord("false", 5);
+            default:
+                if (!isdigit(static_cast<unsigned char>(*p)) && *p != '-')
+                    fail("invalid json input : type not found");
+                stats::node(numberType);
+                token = numberToken;
+            }
+        }
+
+        // returns where it stopped, end unless stopAtEnd
+        const char *feed(const char *p, const char *end)
+        {
+            while (p != end && !(complete && stopAtEnd))
+                switch (token)
+                {
+                case stringToken:
+                case keyToken:
+                {
+                    // a backslash that ended the last piece escapes the
+                    // first character of this one
+                    const char *q = escaped ? p + 1 : p;
+                    escaped = false;
+                    q = findStringEnd(q, end, content);
+                    if (q == end)
+                    {
+                        pending.append(p, end);
+                        size_t backslashes = 0;
+                        while (backslashes < pending.size() && pending[pending.size() - 1 - backslashes] == '\\')
+                            ++backslashes;
+                        escaped = backslashes % 2 == 1;
+                        return end;
+                    }
+                    // a string read in one piece is not copied
+                    std::string_view s(p, q - p);
+                    if (!pending.empty())
+                        s = pending.append(p, q);
+                    s = decodeString(s.data(), s.size(), content, [&](size_t size)
+                                     { decoded.resize(size); return decoded.data(); });
+                    content = 0;
+                    if (token == keyToken)
+                    {
+                        handler.onKey(s);
+                        expect = colon;
+                    }
+                    else
+                    {
+                        handler.onString(s);
+                        valueDone();
+                    }
+                    pending.clear();
+                    token = noToken;
+                    p = q + 1;
+                    break;
+                }
+                case numberToken:
+                {
+                    const char *q = p;
+                    while (q != end && isNumberChar(*q))
+                        ++q;
+                    // the next piece may go on with the digits
+                    if (q == end)
+                    {
+                        pending.append(p, end);
+                        return end;
+                    }
+                    if (pending.empty())
+                        number(p, q - p);
+                    else
+                    {
+                        pending.append(p, q);
+                        number(pending.data(), pending.size());
+                        pending.clear();
+                    }
+                    token = noToken;
+                    p = q;
+                    valueDone();
+                    break;
+                }
+                case wordToken:
+                    for (; p != end && matched < wordSize; ++p, ++matched)
+                        if (*p != word[matched])
+                            fail(*word == 'n' ? "invalid json input : null error" : *word == 't' ? "invalid json input : true error" : "invalid json input : false error");
+                    if (matched < wordSize)
+                        return end;
+                    if (*word == 'n')
+                        handler.onNull();
+                    else
+                        handler.onBool(*word == 't');
+                    token = noToken;
+                    valueDone();
+                    break;
+                case noToken:
+                    if (isWhitespace(*p))
+                    {
+                        ++p;
+                        break;
+                    }
+                    switch (expect)
+                    {
+                    case nothing:
+                        fail("invalid json input : unexpected trailing characters");
+                    case colon:
+                        if (*p != ':')
+                            fail("invalid json input : object error");
+                        ++p;
+                        expect = value;
+                        break;
+                    case commaOrClose:
+                    {
+                        bool object = open.back() == '{';
+                        if (*p == ',')
+                            expect = object ? key : value;
+                        else if (*p == (object ? '}' : ']'))
+                            close();
+                        else
+                            fail(object ? "invalid json input : object error" : "invalid json input : collection error");
+                        ++p;
+                        break;
+                    }
+                    case keyOrClose:
+                        if (*p == '}')
+                        {
+                            close();
+                            ++p;
+                            break;
+                        }
+                        [[fallthrough]];
+                    case key:
+                        if (*p != '"')
+                            fail("invalid json input : object error");
+                        token = keyToken;
+                        ++p;
+                        break;
+                    case valueOrClose:
+                        if (*p == ']')
+                        {
+                            close();
+                            ++p;
+                            break;
+                        }
+                        [[fallthrough]];
+                    case value:
+                        startValue(p);
+                        break;
+                    }
+                    break;
+                }
+            return p;
+        }
+    };
+
+    push_parser::push_parser(const parse_options &options) : state(std::make_unique<machine>(options)) {}
+
+    push_parser::push_parser(sax_handler &handler, const parse_options &options) : state(std::make_unique<machine>(handler, options)) {}
+
+    push_parser::push_parser(push_parser &&) noexcept = default;
+
+    push_parser &push_parser::operator=(push_parser &&) noexcept = default;
+
+    push_parser::~push_parser() = default;
+
+    bool push_parser::feed(const char *data, size_t size)
+    {
+        stats::scope recording(phase::parsing);
+        stats::read(size);
+        if (state->failed)
+            throw json::read_error("invalid json input : push parser failed, reset it first");
+        try
+        {
+            state->feed(data, data + size);
+        }
+        catch (...)
+        {
+            state->failed = true;
+            throw;
+        }
+        return state->complete;
+    }
+
+    bool push_parser::feed(std::string_view piece)
+    {
+        return feed(piece.data(), piece.size());
+    }
+
+    void push_parser::finish()
+    {
+        if (state->failed)
+            throw json::read_error("invalid json input : push parser failed, reset it first");
+        if (state->token == machine::numberToken && state->open.empty())
+        {
+            stats::scope recording(phase::parsing);
+            state->token = machine::noToken;
+            try
+            {
+                state->number(state->pending.data(), state->pending.size());
+            }
+            catch (...)
+            {
+                state->failed = true;
+                throw;
+            }
+            state->pending.clear();
+            state->valueDone();
+        }
+        if (!state->complete)
+            throw json::read_error("invalid json input : unexpected end of input");
+    }
+
+    bool push_parser::done() const
+    {
+        return state->complete;
+    }
+
+    json push_parser::result()
+    {
+        if (!state->built)
+            throw std::logic_error("push parser reports events and builds no document");
+        if (!state->complete)
+            throw json::read_error("invalid json input : unexpected end of input");
+        json j = state->built->builder.result();
+        reset();
+        return j;
+    }
+
+    void push_parser::reset()
+    {
+        machine &m = *state;
+        if (m.built)
+            m.built->clear();
+        m.open.clear();
+        m.expect = machine::value;
+        m.token = machine::noToken;
+        m.escaped = false;
+        m.content = 0;
+        m.complete = false;
+        m.failed = false;
+        m.pending.clear();
+    }
+
+    json parse(std::istream &is)
+    {
+        // takes what the stream has buffered a block at a time and puts
+        // back what follows the value, so the next read starts right after
+        // it even when the stream cannot seek
+        stats::scope recording(phase::parsing);
+        push_parser parser;
+        push_parser::machine &m = *parser.state;
+        m.stopAtEnd = true;
+        std::streambuf *buffer = is.rdbuf();
+        char block[1 << 12];
+        while (!m.complete)
+        {
+            std::streamsize available = buffer->in_avail();
+            if (available <= 0)
+            {
+                if (std::char_traits<char>::eq_int_type(buffer->sgetc(), std::char_traits<char>::eof()))
+                {
+                    is.setstate(std::ios::eofbit);
+                    break;
+                }
+                // an unbuffered stream only lends one character at a time
+                available = std::max<std::streamsize>(buffer->in_avail(), 1);
+            }
+            std::streamsize got = buffer->sgetn(block, std::min<std::streamsize>(available, sizeof(block)));
+            const char *stop = m.feed(block, block + got);
+            stats::read(size_t(stop - block));
+            for (const char *p = block + got; p != stop;)
+                if (std::char_traits<char>::eq_int_type(buffer->sputbackc(*--p), std::char_traits<char>::eof()))
+                {
+                    is.setstate(std::ios::badbit);
+                    break;
+                }
+        }
+        parser.finish();
+        return parser.result();
+    }
+
+    void parse(std::istream &is, sax_handler &handler, const parse_options &options)
+    {
+        push_parser parser(handler, options);
+        std::vector<char> block(1 << 16);
+        do
+        {
+            is.read(block.data(), std::streamsize(block.size()));
+            parser.feed(block.data(), size_t(is.gcount()));
+        } while (is);
+        parser.finish();
+    }
+}
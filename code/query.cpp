@@ -0,0 +1,675 @@
+#include "../include/json.h"
+#include "internals.h"
+#include "strings.h"
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <climits>
+
+namespace badge881::json
+{
+    namespace
+    {
+        struct query_step;
+
+        // one comparison of a filter, or a test that the path exists
+        struct filter_term
+        {
+            enum operation
+            {
+                exists,
+                equal,
+                notEqual,
+                less,
+                lessEqual,
+                greater,
+                greaterEqual
+            };
+
+            // member names and indices below the element, the @ part
+            std::vector<query_step> path;
+            operation op = exists;
+            json literal;
+        };
+
+        struct query_step
+        {
+            enum step_kind
+            {
+                // one or more member names
+                names,
+                // one or more positions, negative ones counted from the end
+                indices,
+                // a json pointer token : a member name, or a position in a collection
+                token,
+                wildcard,
+                slice,
+                filter
+            };
+
+            step_kind kind = names;
+            // .. in front of the step, which then applies at any depth
+            bool recursive = false;
+            std::vector<std::string> keys;
+            std::vector<long long> positions;
+            long long start = 0;
+            long long end = 0;
+            long long stride = 1;
+            bool hasStart = false;
+            bool hasEnd = false;
+            // alternatives of conjunctions
+            std::vector<std::vector<filter_term>> conditions;
+
+            // a step that cannot decide on an element before the collection
+            // is complete, such as one counting from the end
+            bool needsWhole() const
+            {
+                // unions come out in the order they are written
+                if (kind == indices)
+                    return !std::is_sorted(positions.begin(), positions.end()) || positions[0] < 0;
+                if (kind == names)
+                    return keys.size() > 1;
+                if (kind == slice)
+                    return stride < 0 || (hasStart && start < 0) || (hasEnd && end < 0);
+                return false;
+            }
+
+            bool matchesKey(std::string_view key) const
+            {
+                switch (kind)
+                {
+                case names:
+                case token:
+                    return std::find(keys.begin(), keys.end(), key) != keys.end();
+                case wildcard:
+                    return true;
+                default:
+                    return false;
+                }
+            }
+
+            // positions counted from the end have been resolved by the caller
+            bool matchesPosition(long long position, long long size) const
+            {
+                switch (kind)
+                {
+                case indices:
+                    return std::any_of(positions.begin(), positions.end(), [&](long long p)
+                                       { return (p < 0 ? p + size : p) == position; });
+                case token:
+                    return !positions.empty() && positions[0] == position;
+                case wildcard:
+                    return true;
+                case slice:
+                {
+                    if (stride == 0)
+                        return false;
+                    long long first = hasStart ? (start < 0 ? std::max(start + size, 0LL) : start) : (stride > 0 ? 0 : size - 1);
+                    if (stride > 0)
+                    {
+                        long long last = hasEnd ? (end < 0 ? end + size : end) : LLONG_MAX;
+                        return position >= first && position < last && (position - first) % stride == 0;
+                    }
+                    long long last = hasEnd ? (end < 0 ? end + size : end) : -1;
+                    return position <= first && position > last && (first - position) % -stride == 0;
+                }
+                default:
+                    return false;
+                }
+            }
+        };
+
+        // reads the text of a query into steps. json pointers start with a
+        // slash or are empty, json paths start with $
+        class query_compiler
+        {
+            std::string_view text;
+            size_t at = 0;
+
+            [[noreturn]] void invalid(const char *problem) const
+            {
+                throw json::read_error("invalid query : " + std::string(problem) + " at " + std::to_string(at) + " in " + std::string(text));
+            }
+
+            bool next(char c)
+            {
+                skipSpaces();
+                if (at < text.size() && text[at] == c)
+                {
+                    ++at;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(char c, const char *problem)
+            {
+                if (!next(c))
+                    invalid(problem);
+            }
+
+            void skipSpaces()
+            {
+                while (at < text.size() && text[at] == ' ')
+                    ++at;
+            }
+
+            bool atNumber()
+            {
+                skipSpaces();
+                return at < text.size() && (std::isdigit(static_cast<unsigned char>(text[at])) || text[at] == '-');
+            }
+
+            long long integer()
+            {
+                skipSpaces();
+                long long value = 0;
+                auto [end, error] = std::from_chars(text.data() + at, text.data() + text.size(), value);
+                // past 64 bits an index reaches no element and a slice bound
+                // covers the whole collection, the largest ones do the same.
+                // -LLONG_MAX keeps a negated stride in range
+                if (error == std::errc::result_out_of_range)
+                    value = text[at] == '-' ? -LLONG_MAX : LLONG_MAX;
+                else if (error != std::errc())
+                    invalid("integer expected");
+                at = end - text.data();
+                return value;
+            }
+
+            // escapes are read the way json reads them, plus \' in names
+            // quoted that way
+            std::string quoted()
+            {
+                skipSpaces();
+                char quote = text[at++];
+                std::string name;
+                while (at < text.size() && text[at] != quote)
+                    if (text[at] == '\\' && at + 1 < text.size() && text[at + 1] == '\'')
+                    {
+                        name += '\'';
+                        at += 2;
+                    }
+                    else
+                    {
+                        size_t length = text[at] == '\\' && at + 1 < text.size() ? 2 : 1;
+                        name.append(text.substr(at, length));
+                        at += length;
+                    }
+                if (at >= text.size())
+                    invalid("unterminated name");
+                ++at;
+                try
+                {
+                    name.resize(size_t(decodeEscapes(name.data(), name.size(), name.data()) - name.data()));
+                }
+                catch (const json::read_error &)
+                {
+                    invalid("invalid escape");
+                }
+                return name;
+            }
+
+            std::string dotted()
+            {
+                size_t start = at;
+                while (at < text.size() && text[at] != '.' && text[at] != '[' && text[at] != ' ' && text[at] != ')' &&
+                       text[at] != '=' && text[at] != '!' && text[at] != '<' && text[at] != '>' && text[at] != '&' && text[at] != '|')
+                    ++at;
+                if (at == start)
+                    invalid("name expected");
+                return std::string(text.substr(start, at - start));
+            }
+
+            json literal()
+            {
+                skipSpaces();
+                if (at < text.size() && (text[at] == '\'' || text[at] == '"'))
+                    return json(quoted());
+                size_t start = at;
+                while (at < text.size() && text[at] != ' ' && text[at] != ')' && text[at] != '&' && text[at] != '|')
+                    ++at;
+                try
+                {
+                    return parse(text.substr(start, at - start));
+                }
+                catch (const json::read_error &)
+                {
+                    invalid("value expected");
+                }
+            }
+
+            filter_term term()
+            {
+                filter_term t;
+                expect('@', "@ expected");
+                while (true)
+                {
+                    if (at < text.size() && text[at] == '.')
+                    {
+                        ++at;
+                        query_step s;
+                        s.keys.push_back(dotted());
+                        t.path.push_back(std::move(s));
+                    }
+                    else if (at < text.size() && text[at] == '[')
+                        t.path.push_back(bracket(false));
+                    else
+                        break;
+                }
+                skipSpaces();
+                static const std::pair<const char *, filter_term::operation> operations[] = {{"==", filter_term::equal}, {"!=", filter_term::notEqual}, {"<=", filter_term::lessEqual}, {">=", filter_term::greaterEqual}, {"<", filter_term::less}, {">", filter_term::greater}};
+                for (auto [spelling, op] : operations)
+                    if (text.substr(at, std::strlen(spelling)) == spelling)
+                    {
+                        at += std::strlen(spelling);
+                        t.op = op;
+                        t.literal = literal();
+                        break;
+                    }
+                return t;
+            }
+
+            // what follows an opening bracket, filters only outside of filters
+            query_step bracket(bool filters)
+            {
+                expect('[', "[ expected");
+                query_step s;
+                skipSpaces();
+                if (next('*'))
+                    s.kind = query_step::wildcard;
+                else if (filters && next('?'))
+                {
+                    s.kind = query_step::filter;
+                    expect('(', "( expected after ?");
+                    s.conditions.emplace_back();
+                    while (true)
+                    {
+                        s.conditions.back().push_back(term());
+                        if (next('&'))
+                            expect('&', "&& expected");
+                        else if (next('|'))
+                        {
+                            expect('|', "|| expected");
+                            s.conditions.emplace_back();
+                        }
+                        else
+                            break;
+                    }
+                    expect(')', ") expected");
+                }
+                else if (at < text.size() && (text[at] == '\'' || text[at] == '"'))
+                {
+                    do
+                        s.keys.push_back(quoted());
+                    while (next(','));
+                }
+                else
+                {
+                    s.kind = query_step::indices;
+                    bool colon = false;
+                    if (atNumber())
+                    {
+                        s.start = integer();
+                        s.hasStart = true;
+                    }
+                    if (next(':'))
+                    {
+                        colon = true;
+                        s.kind = query_step::slice;
+                        if (atNumber())
+                        {
+                            s.end = integer();
+                            s.hasEnd = true;
+                        }
+                        if (next(':') && atNumber())
+                            s.stride = integer();
+                    }
+                    if (!colon)
+                    {
+                        if (!s.hasStart)
+                            invalid("index, slice, name, * or filter expected");
+                        s.positions.push_back(s.start);
+                        while (next(','))
+                            s.positions.push_back(integer());
+                    }
+                }
+                expect(']', "] expected");
+                return s;
+            }
+
+            std::vector<query_step> pointer()
+            {
+                std::vector<query_step> steps;
+                while (at < text.size())
+                {
+                    if (text[at++] != '/')
+                        invalid("/ expected");
+                    size_t slash = std::min(text.find('/', at), text.size());
+                    query_step s;
+                    s.kind = query_step::token;
+                    std::string key;
+                    for (size_t i = at; i < slash; ++i)
+                        if (text[i] != '~')
+                            key += text[i];
+                        else if (i + 1 < slash && (text[i + 1] == '0' || text[i + 1] == '1'))
+                            key += text[++i] == '0' ? '~' : '/';
+                        else
+                        {
+                            at = i;
+                            invalid("~ is not followed by 0 or 1");
+                        }
+                    // array positions are written without sign or leading zero
+                    long long position;
+                    if (!key.empty() && (key == "0" || key[0] != '0') && key.find_first_not_of("0123456789") == std::string::npos &&
+                        std::from_chars(key.data(), key.data() + key.size(), position).ec == std::errc())
+                        s.positions.push_back(position);
+                    s.keys.push_back(std::move(key));
+                    steps.push_back(std::move(s));
+                    at = slash;
+                }
+                return steps;
+            }
+
+            std::vector<query_step> path()
+            {
+                std::vector<query_step> steps;
+                expect('$', "$ expected");
+                while (at < text.size())
+                {
+                    bool recursive = false;
+                    query_step s;
+                    if (text.substr(at, 2) == "..")
+                    {
+                        at += 2;
+                        recursive = true;
+                        if (at < text.size() && text[at] == '[')
+                            s = bracket(true);
+                        else if (next('*'))
+                            s.kind = query_step::wildcard;
+                        else
+                            s.keys.push_back(dotted());
+                    }
+                    else if (next('.'))
+                    {
+                        if (next('*'))
+                            s.kind = query_step::wildcard;
+                        else
+                            s.keys.push_back(dotted());
+                    }
+                    else if (at < text.size() && text[at] == '[')
+                        s = bracket(true);
+                    else
+                        invalid(". or [ expected");
+                    s.recursive = recursive;
+                    steps.push_back(std::move(s));
+                }
+                return steps;
+            }
+
+        public:
+            explicit query_compiler(std::string_view t) : text(t) {}
+
+            std::vector<query_step> compile()
+            {
+                if (text.empty() || text[0] == '/')
+                    return pointer();
+                return path();
+            }
+        };
+
+        const json *follow(const std::vector<query_step> &path, const json &value)
+        {
+            const json *at = &value;
+            for (const query_step &s : path)
+            {
+                if (at->isObject() && !s.keys.empty())
+                    at = node_access::findMember(*at, s.keys[0]);
+                else if (at->isCollection() && !s.positions.empty())
+                {
+                    auto [elements, size] = node_access::elements(*at);
+                    long long p = s.positions[0] < 0 ? s.positions[0] + (long long)size : s.positions[0];
+                    at = p >= 0 && p < (long long)size ? elements + p : nullptr;
+                }
+                else
+                    at = nullptr;
+                if (!at)
+                    return nullptr;
+            }
+            return at;
+        }
+
+        bool holds(const filter_term &t, const json &element)
+        {
+            const json *value = follow(t.path, element);
+            if (!value)
+                return false;
+            switch (t.op)
+            {
+            case filter_term::exists:
+                return true;
+            case filter_term::equal:
+                return *value == t.literal;
+            case filter_term::notEqual:
+                return *value != t.literal;
+            default:
+                break;
+            }
+            int order;
+            if (value->isNumber() && t.literal.isNumber())
+            {
+                double a = value->get<double>(), b = t.literal.get<double>();
+                order = a < b ? -1 : a > b ? 1 : 0;
+            }
+            else if (value->isString() && t.literal.isString())
+                order = value->getStringView().compare(t.literal.getStringView());
+            else
+                return false;
+            switch (t.op)
+            {
+            case filter_term::less:
+                return order < 0;
+            case filter_term::lessEqual:
+                return order <= 0;
+            case filter_term::greater:
+                return order > 0;
+            default:
+                return order >= 0;
+            }
+        }
+
+        bool passes(const query_step &s, const json &element)
+        {
+            return std::any_of(s.conditions.begin(), s.conditions.end(), [&](const std::vector<filter_term> &all)
+                               { return std::all_of(all.begin(), all.end(), [&](const filter_term &t)
+                                                    { return holds(t, element); }); });
+        }
+
+        // runs the steps from position first on a value in memory, reporting
+        // the matches in document order until found returns false. what is
+        // left to run sits on a stack instead of the call stack, recursive
+        // descent goes as deep as the document does
+        template <typename functionT>
+        void evaluate(const std::vector<query_step> &steps, size_t first, const json &root, functionT &&found)
+        {
+            std::vector<std::pair<size_t, const json *>> pending{{first, &root}};
+            // the runs one value leads to, in document order
+            std::vector<std::pair<size_t, const json *>> next;
+            while (!pending.empty())
+            {
+                auto [i, value] = pending.back();
+                pending.pop_back();
+                if (i == steps.size())
+                {
+                    if (!found(*value))
+                        return;
+                    continue;
+                }
+                const query_step &s = steps[i];
+                next.clear();
+                auto child = [&](const json &element, bool matches)
+                {
+                    if (matches)
+                        next.emplace_back(i + 1, &element);
+                    if (s.recursive)
+                        next.emplace_back(i, &element);
+                };
+                if (value->isCollection())
+                {
+                    auto [elements, size] = node_access::elements(*value);
+                    if (s.kind == query_step::slice && s.stride < 0)
+                        for (size_t p = size; p-- > 0;)
+                            child(elements[p], s.matchesPosition((long long)p, (long long)size));
+                    else if (s.kind == query_step::indices && !s.recursive)
+                    {
+                        for (long long p : s.positions)
+                            if (p = p < 0 ? p + (long long)size : p; p >= 0 && p < (long long)size)
+                                child(elements[p], true);
+                    }
+                    else
+                        for (size_t p = 0; p < size; ++p)
+                            child(elements[p], s.kind == query_step::filter ? passes(s, elements[p]) : s.matchesPosition((long long)p, (long long)size));
+                }
+                else if (value->isObject() && s.kind == query_step::names && !s.recursive)
+                {
+                    for (const std::string &key : s.keys)
+                        if (const json *member = node_access::findMember(*value, key))
+                            child(*member, true);
+                }
+                else if (value->isObject())
+                    node_access::forEachMember(*value, [&](std::string_view key, const json &member)
+                                               { child(member, s.kind == query_step::filter ? passes(s, member) : s.matchesKey(key)); });
+                pending.insert(pending.end(), next.rbegin(), next.rend());
+            }
+        }
+
+        // runs the steps over text : every value is reached with the steps
+        // still open on it, values without any are skipped unread and only
+        // matches, or collections a step needs whole, are built
+        class stream_query
+        {
+            const std::vector<query_step> &steps;
+            std::vector<json> &out;
+
+            void add(std::vector<size_t> &states, size_t state)
+            {
+                if (std::find(states.begin(), states.end(), state) == states.end())
+                    states.push_back(state);
+            }
+
+            // the rest of the query on a value that had to be built
+            void built(const json &value, const std::vector<size_t> &states)
+            {
+                for (size_t state : states)
+                    if (state == steps.size())
+                        out.push_back(value);
+                    else
+                        evaluate(steps, state, value, [&](const json &match)
+                                 { out.push_back(match); return true; });
+            }
+
+            // a member or element of a container reached with states, filters
+            // only decide on it once it is built
+            void child(token_reader &reader, const std::vector<size_t> &states, std::vector<size_t> &inner, bool filtered)
+            {
+                if (!filtered)
+                    return value(reader, inner);
+                json element = reader.readValue();
+                for (size_t state : states)
+                    if (steps[state].kind == query_step::filter && passes(steps[state], element))
+                        add(inner, state + 1);
+                built(element, inner);
+            }
+
+        public:
+            stream_query(const std::vector<query_step> &s, std::vector<json> &o) : steps(s), out(o) {}
+
+            void value(token_reader &reader, const std::vector<size_t> &states)
+            {
+                if (states.empty())
+                    return reader.skipValue();
+                type t = reader.peekType();
+                bool matched = std::find(states.begin(), states.end(), steps.size()) != states.end();
+                bool whole = matched;
+                bool filtered = false;
+                if (t == objectType || t == collectionType)
+                {
+                    for (size_t state : states)
+                        if (state < steps.size())
+                        {
+                            whole = whole || steps[state].needsWhole();
+                            filtered = filtered || steps[state].kind == query_step::filter;
+                        }
+                }
+                else if (!matched)
+                    return reader.skipValue();
+                if (whole)
+                    return built(reader.readValue(), states);
+                std::vector<size_t> inner;
+                if (t == objectType)
+                {
+                    reader.beginObject();
+                    std::string_view key;
+                    while (reader.nextKey(key))
+                    {
+                        inner.clear();
+                        for (size_t state : states)
+                        {
+                            if (steps[state].matchesKey(key))
+                                add(inner, state + 1);
+                            if (steps[state].recursive)
+                                add(inner, state);
+                        }
+                        child(reader, states, inner, filtered);
+                    }
+                    return;
+                }
+                reader.beginCollection();
+                for (long long p = 0; reader.nextElement(); ++p)
+                {
+                    inner.clear();
+                    for (size_t state : states)
+                    {
+                        // the size is only needed by steps that were built whole
+                        if (steps[state].matchesPosition(p, LLONG_MAX))
+                            add(inner, state + 1);
+                        if (steps[state].recursive)
+                            add(inner, state);
+                    }
+                    child(reader, states, inner, filtered);
+                }
+            }
+        };
+    }
+
+    struct query::program
+    {
+        std::vector<query_step> steps;
+    };
+
+    query::query(std::string_view text) : compiled(std::make_shared<program>(program{query_compiler(text).compile()})) {}
+
+    std::vector<const json *> query::select(const json &document) const
+    {
+        std::vector<const json *> found;
+        evaluate(compiled->steps, 0, document, [&](const json &match)
+                 { found.push_back(&match); return true; });
+        return found;
+    }
+
+    const json *query::first(const json &document) const
+    {
+        const json *found = nullptr;
+        evaluate(compiled->steps, 0, document, [&](const json &match)
+                 { found = &match; return false; });
+        return found;
+    }
+
+    std::vector<json> query::selectText(std::string_view text, const parse_options &options) const
+    {
+        std::vector<json> found;
+        token_reader reader(text, options);
+        stream_query(compiled->steps, found).value(reader, {0});
+        reader.finish();
+        return found;
+    }
+}
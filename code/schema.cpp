@@ -0,0 +1,1132 @@
+#include "../include/json.h"
+#include "internals.h"
+#include "parser.h"
+#include <regex>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace badge881::json
+{
+    namespace
+    {
+        enum type_bits : unsigned
+        {
+            nullBit = 1,
+            booleanBit = 2,
+            integerBit = 4,
+            fractionBit = 8,
+            stringBit = 16,
+            objectBit = 32,
+            collectionBit = 64,
+            anyBit = 127
+        };
+
+        constexpr size_t none = size_t(-1);
+
+        // one subschema with its keywords read into fields and the
+        // subschemas it refers to resolved to positions in the program
+        struct schema_node
+        {
+            // the false schema, or additionalProperties : false
+            bool rejectAll = false;
+            unsigned types = anyBit;
+            bool hasConst = false;
+            json constant;
+            bool hasEnum = false;
+            std::vector<json> enumeration;
+
+            // null when absent, otherwise the number as written so that
+            // integer bounds stay exact
+            json minimum;
+            json exclusiveMinimum;
+            json maximum;
+            json exclusiveMaximum;
+            json multipleOf;
+
+            size_t minLength = 0;
+            size_t maxLength = none;
+            std::string patternText;
+            std::unique_ptr<std::regex> pattern;
+
+            size_t minItems = 0;
+            size_t maxItems = none;
+            bool uniqueItems = false;
+            size_t items = none;
+            bool tuple = false;
+            std::vector<size_t> tupleItems;
+            size_t additionalItems = none;
+            size_t contains = none;
+
+            size_t minProperties = 0;
+            size_t maxProperties = none;
+            std::vector<std::string> required;
+            // sorted by name
+            std::vector<std::pair<std::string, size_t>> properties;
+            std::vector<std::pair<std::regex, size_t>> patternProperties;
+            size_t additionalProperties = none;
+            size_t propertyNames = none;
+            std::vector<std::pair<std::string, std::vector<std::string>>> requiredDependencies;
+            std::vector<std::pair<std::string, size_t>> schemaDependencies;
+
+            size_t reference = none;
+            std::vector<size_t> allOf;
+            std::vector<size_t> anyOf;
+            std::vector<size_t> oneOf;
+            size_t negated = none;
+            size_t condition = none;
+            size_t then = none;
+            size_t otherwise = none;
+
+            // decided on the value as a whole, streaming builds such values
+            bool wholeValue = false;
+
+            size_t property(std::string_view name) const
+            {
+                auto found = std::lower_bound(properties.begin(), properties.end(), name, [](const auto &entry, std::string_view key)
+                                              { return std::string_view(entry.first) < key; });
+                return found != properties.end() && found->first == name ? found->second : none;
+            }
+        };
+
+        std::string escapeSegment(std::string_view segment)
+        {
+            std::string out;
+            for (char c : segment)
+                if (c == '~')
+                    out += "~0";
+                else if (c == '/')
+                    out += "~1";
+                else
+                    out += c;
+            return out;
+        }
+
+        std::string unescapeSegment(std::string_view segment)
+        {
+            std::string out;
+            for (size_t i = 0; i < segment.size(); ++i)
+                if (segment[i] == '~' && i + 1 < segment.size() && (segment[i + 1] == '0' || segment[i + 1] == '1'))
+                    out += segment[++i] == '0' ? '~' : '/';
+                else
+                    out += segment[i];
+            return out;
+        }
+
+        // code points of a utf-8 string, continuation bytes are not counted
+        size_t codePoints(std::string_view s)
+        {
+            size_t count = 0;
+            for (char c : s)
+                if ((static_cast<unsigned char>(c) & 0xc0) != 0x80)
+                    ++count;
+            return count;
+        }
+
+        unsigned typeBit(const json &value)
+        {
+            switch (value.getType())
+            {
+            case nullType:
+                return nullBit;
+            case booleanType:
+                return booleanBit;
+            case numberType:
+            {
+                if (value.isInteger())
+                    return integerBit;
+                double number = value.get<double>();
+                return std::isfinite(number) && number == std::trunc(number) ? integerBit : fractionBit;
+            }
+            case stringType:
+                return stringBit;
+            case objectType:
+                return objectBit;
+            case collectionType:
+                return collectionBit;
+            }
+            return nullBit;
+        }
+
+        // an integer against a double, exactly : the double is cut to its
+        // integer part, which converts without loss, and the fraction left
+        // decides a tie
+        template <typename integerT>
+        int compareInteger(integerT integer, double real, double low, double high)
+        {
+            if (std::isnan(real))
+                return 0;
+            if (real < low)
+                return 1;
+            if (real >= high)
+                return -1;
+            double whole = std::trunc(real);
+            integerT cut = static_cast<integerT>(whole);
+            if (integer != cut)
+                return integer < cut ? -1 : 1;
+            return real > whole ? -1 : real < whole ? 1 : 0;
+        }
+
+        // below zero, zero or above zero as a is below, equal to or above b.
+        // integers never go through a double
+        int compareNumbers(const json &a, const json &b)
+        {
+            constexpr double signedLow = -9223372036854775808.0;
+            constexpr double unsignedHigh = 18446744073709551616.0;
+            bool aNegative = a.get<double>() < 0;
+            bool bNegative = b.get<double>() < 0;
+            if (a.isInteger() && b.isInteger())
+            {
+                if (aNegative != bNegative)
+                    return aNegative ? -1 : 1;
+                if (aNegative)
+                {
+                    long long x = a.get<long long>(), y = b.get<long long>();
+                    return x < y ? -1 : x > y ? 1 : 0;
+                }
+                unsigned long long x = a.get<unsigned long long>(), y = b.get<unsigned long long>();
+                return x < y ? -1 : x > y ? 1 : 0;
+            }
+            if (a.isInteger())
+            {
+                if (aNegative)
+                    return compareInteger(a.get<long long>(), b.get<double>(), signedLow, 0.0);
+                return compareInteger(a.get<unsigned long long>(), b.get<double>(), 0.0, unsignedHigh);
+            }
+            if (b.isInteger())
+                return -compareNumbers(b, a);
+            double x = a.get<double>(), y = b.get<double>();
+            return x < y ? -1 : x > y ? 1 : 0;
+        }
+
+        std::string typeNames(unsigned types)
+        {
+            static const std::pair<unsigned, const char *> names[] = {{nullBit, "null"}, {booleanBit, "boolean"}, {integerBit | fractionBit, "number"}, {integerBit, "integer"}, {fractionBit, "number"}, {stringBit, "string"}, {objectBit, "object"}, {collectionBit, "array"}};
+            std::string out;
+            for (auto [bits, name] : names)
+                if ((types & bits) == bits)
+                {
+                    if (!out.empty())
+                        out += " or ";
+                    out += name;
+                    types &= ~bits;
+                }
+            return out;
+        }
+
+        // reads a schema document into nodes. every subschema is compiled
+        // once under its json pointer, so $ref to a schema that is still
+        // being compiled, a recursive one, gets its position straight away
+        class schema_compiler
+        {
+            const json &root;
+            std::vector<schema_node> &nodes;
+            std::unordered_map<std::string, size_t> compiled;
+            // plain name fragments declared by $id, such as #foo, with the
+            // schema and its json pointer
+            std::unordered_map<std::string, std::pair<const json *, std::string>> anchors;
+
+            [[noreturn]] static void invalid(const std::string &pointer, const std::string &problem)
+            {
+                throw json::type_error("invalid schema at \'" + pointer + "\' : " + problem);
+            }
+
+            static json number(const json &value, const std::string &pointer, const char *keyword)
+            {
+                if (!value.isNumber())
+                    invalid(pointer, std::string(keyword) + " is not a number");
+                return value;
+            }
+
+            // counts beyond size_t are as good as no limit
+            static size_t count(const json &value, const std::string &pointer, const char *keyword)
+            {
+                if (!value.isNumber() || value.get<double>() < 0 || typeBit(value) != integerBit)
+                    invalid(pointer, std::string(keyword) + " is not a non negative integer");
+                if (value.isInteger())
+                    return size_t(std::min<unsigned long long>(value.get<unsigned long long>(), none));
+                return value.get<double>() >= double(none) ? none : size_t(value.get<double>());
+            }
+
+            static std::vector<std::string> names(const json &value, const std::string &pointer, const char *keyword)
+            {
+                if (!value.isCollection())
+                    invalid(pointer, std::string(keyword) + " is not an array");
+                std::vector<std::string> out;
+                for (const json &name : value.get<std::vector<json>>())
+                {
+                    if (!name.isString())
+                        invalid(pointer, std::string(keyword) + " holds something else than strings");
+                    out.emplace_back(name.getStringView());
+                }
+                return out;
+            }
+
+            static std::regex regex(const json &value, const std::string &pointer)
+            {
+                if (!value.isString())
+                    invalid(pointer, "pattern is not a string");
+                try
+                {
+                    return std::regex(std::string(value.getStringView()), std::regex::ECMAScript);
+                }
+                catch (const std::regex_error &)
+                {
+                    invalid(pointer, "pattern does not compile : " + std::string(value.getStringView()));
+                }
+            }
+
+            unsigned types(const json &value, const std::string &pointer)
+            {
+                auto bits = [&](const json &name) -> unsigned
+                {
+                    std::string_view t = name.isString() ? name.getStringView() : std::string_view();
+                    if (t == "null")
+                        return nullBit;
+                    if (t == "boolean")
+                        return booleanBit;
+                    if (t == "integer")
+                        return integerBit;
+                    if (t == "number")
+                        return integerBit | fractionBit;
+                    if (t == "string")
+                        return stringBit;
+                    if (t == "object")
+                        return objectBit;
+                    if (t == "array")
+                        return collectionBit;
+                    invalid(pointer, "unknown type");
+                };
+                if (!value.isCollection())
+                    return bits(value);
+                unsigned out = 0;
+                for (const json &name : value.get<std::vector<json>>())
+                    out |= bits(name);
+                return out;
+            }
+
+            std::vector<size_t> list(const json &value, const std::string &pointer, const char *keyword)
+            {
+                if (!value.isCollection())
+                    invalid(pointer, std::string(keyword) + " is not an array");
+                std::vector<size_t> out;
+                auto [schemas, size] = node_access::elements(value);
+                for (size_t i = 0; i < size; ++i)
+                    out.push_back(compile(schemas[i], pointer + "/" + keyword + "/" + std::to_string(i)));
+                return out;
+            }
+
+            size_t resolve(const std::string &reference, const std::string &pointer)
+            {
+                if (reference.empty() || reference[0] != '#')
+                    invalid(pointer, "only references inside the schema are supported : " + reference);
+                std::string target = reference.substr(1);
+                if (!target.empty() && target[0] != '/')
+                {
+                    auto anchor = anchors.find(target);
+                    if (anchor == anchors.end())
+                        invalid(pointer, "unresolved reference : " + reference);
+                    return compile(*anchor->second.first, anchor->second.second);
+                }
+                if (auto found = compiled.find(target); found != compiled.end())
+                    return found->second;
+                const json *at = &root;
+                size_t start = 1;
+                while (start <= target.size() && !target.empty())
+                {
+                    size_t slash = target.find('/', start);
+                    if (slash == std::string::npos)
+                        slash = target.size();
+                    std::string segment = unescapeSegment(std::string_view(target).substr(start, slash - start));
+                    if (at->isObject())
+                        at = at->find(segment);
+                    else if (at->isCollection() && !segment.empty() && segment.size() < 10 && segment.find_first_not_of("0123456789") == std::string::npos)
+                    {
+                        auto [elements, size] = node_access::elements(*at);
+                        size_t i = std::stoul(segment);
+                        at = i < size ? elements + i : nullptr;
+                    }
+                    else
+                        at = nullptr;
+                    if (!at)
+                        invalid(pointer, "unresolved reference : " + reference);
+                    start = slash + 1;
+                }
+                return compile(*at, target);
+            }
+
+            // walks the whole document once for $id anchors, leaving out
+            // enum and const which hold values rather than schemas
+            void findAnchors()
+            {
+                std::vector<std::pair<const json *, std::string>> pending{{&root, ""}};
+                while (!pending.empty())
+                {
+                    auto [s, pointer] = std::move(pending.back());
+                    pending.pop_back();
+                    if (s->isCollection())
+                    {
+                        auto [elements, size] = node_access::elements(*s);
+                        for (size_t i = 0; i < size; ++i)
+                            pending.emplace_back(elements + i, pointer + "/" + std::to_string(i));
+                        continue;
+                    }
+                    if (!s->isObject())
+                        continue;
+                    const json *id = s->find("$id");
+                    if (id && id->isString())
+                    {
+                        std::string_view name = id->getStringView();
+                        if (name.size() > 1 && name[0] == '#' && name[1] != '/' && !anchors.emplace(name.substr(1), std::make_pair(s, pointer)).second)
+                            invalid(pointer, "$id declared twice : " + std::string(name));
+                    }
+                    node_access::forEachMember(*s, [&](std::string_view key, const json &member)
+                                               {
+                                                   if (key != "enum" && key != "const")
+                                                       pending.emplace_back(&member, pointer + "/" + escapeSegment(key)); });
+                }
+            }
+
+        public:
+            schema_compiler(const json &r, std::vector<schema_node> &n) : root(r), nodes(n)
+            {
+                findAnchors();
+            }
+
+            size_t compile(const json &s, const std::string &pointer)
+            {
+                if (auto found = compiled.find(pointer); found != compiled.end())
+                    return found->second;
+                size_t index = nodes.size();
+                nodes.emplace_back();
+                compiled.emplace(pointer, index);
+                schema_node node;
+                if (s.isBoolean())
+                {
+                    node.rejectAll = !s.get<bool>();
+                    nodes[index] = std::move(node);
+                    return index;
+                }
+                if (!s.isObject())
+                    invalid(pointer, "a schema is an object or a boolean");
+                auto at = [&](const char *keyword)
+                {
+                    return pointer + "/" + keyword;
+                };
+
+                if (const json *v = s.find("$ref"))
+                {
+                    if (!v->isString())
+                        invalid(pointer, "$ref is not a string");
+                    node.reference = resolve(std::string(v->getStringView()), pointer);
+                }
+                if (const json *v = s.find("type"))
+                    node.types = types(*v, pointer);
+                if (const json *v = s.find("const"))
+                {
+                    node.hasConst = true;
+                    node.constant = *v;
+                }
+                if (const json *v = s.find("enum"))
+                {
+                    if (!v->isCollection())
+                        invalid(pointer, "enum is not an array");
+                    node.hasEnum = true;
+                    node.enumeration = v->get<std::vector<json>>();
+                }
+
+                if (const json *v = s.find("minimum"))
+                    node.minimum = number(*v, pointer, "minimum");
+                if (const json *v = s.find("maximum"))
+                    node.maximum = number(*v, pointer, "maximum");
+                if (const json *v = s.find("exclusiveMinimum"))
+                    node.exclusiveMinimum = number(*v, pointer, "exclusiveMinimum");
+                if (const json *v = s.find("exclusiveMaximum"))
+                    node.exclusiveMaximum = number(*v, pointer, "exclusiveMaximum");
+                if (const json *v = s.find("multipleOf"))
+                {
+                    node.multipleOf = number(*v, pointer, "multipleOf");
+                    if (v->get<double>() <= 0)
+                        invalid(pointer, "multipleOf is not above zero");
+                }
+
+                if (const json *v = s.find("minLength"))
+                    node.minLength = count(*v, pointer, "minLength");
+                if (const json *v = s.find("maxLength"))
+                    node.maxLength = count(*v, pointer, "maxLength");
+                if (const json *v = s.find("pattern"))
+                {
+                    node.pattern = std::make_unique<std::regex>(regex(*v, pointer));
+                    node.patternText = std::string(v->getStringView());
+                }
+
+                if (const json *v = s.find("minItems"))
+                    node.minItems = count(*v, pointer, "minItems");
+                if (const json *v = s.find("maxItems"))
+                    node.maxItems = count(*v, pointer, "maxItems");
+                if (const json *v = s.find("uniqueItems"))
+                    node.uniqueItems = v->isBoolean() && v->get<bool>();
+                if (const json *v = s.find("items"))
+                {
+                    if (v->isCollection())
+                    {
+                        node.tuple = true;
+                        node.tupleItems = list(*v, pointer, "items");
+                    }
+                    else
+                        node.items = compile(*v, at("items"));
+                }
+                if (const json *v = s.find("additionalItems"); v && node.tuple)
+                    node.additionalItems = compile(*v, at("additionalItems"));
+                if (const json *v = s.find("contains"))
+                    node.contains = compile(*v, at("contains"));
+
+                if (const json *v = s.find("minProperties"))
+                    node.minProperties = count(*v, pointer, "minProperties");
+                if (const json *v = s.find("maxProperties"))
+                    node.maxProperties = count(*v, pointer, "maxProperties");
+                if (const json *v = s.find("required"))
+                    node.required = names(*v, pointer, "required");
+                if (const json *v = s.find("properties"))
+                {
+                    if (!v->isObject())
+                        invalid(pointer, "properties is not an object");
+                    node_access::forEachMember(*v, [&](std::string_view name, const json &subschema)
+                                               { node.properties.emplace_back(name, compile(subschema, at("properties") + "/" + escapeSegment(name))); });
+                    std::sort(node.properties.begin(), node.properties.end());
+                }
+                if (const json *v = s.find("patternProperties"))
+                {
+                    if (!v->isObject())
+                        invalid(pointer, "patternProperties is not an object");
+                    node_access::forEachMember(*v, [&](std::string_view name, const json &subschema)
+                                               { node.patternProperties.emplace_back(regex(json(std::string(name)), pointer), compile(subschema, at("patternProperties") + "/" + escapeSegment(name))); });
+                }
+                if (const json *v = s.find("additionalProperties"))
+                    node.additionalProperties = compile(*v, at("additionalProperties"));
+                if (const json *v = s.find("propertyNames"))
+                    node.propertyNames = compile(*v, at("propertyNames"));
+                if (const json *v = s.find("dependencies"))
+                {
+                    if (!v->isObject())
+                        invalid(pointer, "dependencies is not an object");
+                    node_access::forEachMember(*v, [&](std::string_view name, const json &dependency)
+                                               {
+                                                   if (dependency.isCollection())
+                                                       node.requiredDependencies.emplace_back(name, names(dependency, pointer, "dependencies"));
+                                                   else
+                                                       node.schemaDependencies.emplace_back(name, compile(dependency, at("dependencies") + "/" + escapeSegment(name))); });
+                }
+
+                if (const json *v = s.find("allOf"))
+                    node.allOf = list(*v, pointer, "allOf");
+                if (const json *v = s.find("anyOf"))
+                    node.anyOf = list(*v, pointer, "anyOf");
+                if (const json *v = s.find("oneOf"))
+                    node.oneOf = list(*v, pointer, "oneOf");
+                if (const json *v = s.find("not"))
+                    node.negated = compile(*v, at("not"));
+                if (const json *v = s.find("if"))
+                {
+                    node.condition = compile(*v, at("if"));
+                    if (const json *branch = s.find("then"))
+                        node.then = compile(*branch, at("then"));
+                    if (const json *branch = s.find("else"))
+                        node.otherwise = compile(*branch, at("else"));
+                }
+
+                node.wholeValue = node.hasConst || node.hasEnum || node.uniqueItems || node.contains != none || !node.requiredDependencies.empty() ||
+                                  !node.schemaDependencies.empty() || !node.anyOf.empty() || !node.oneOf.empty() || node.negated != none || node.condition != none;
+                nodes[index] = std::move(node);
+                return index;
+            }
+        };
+
+        // where a value sits in the document, turned into a json pointer
+        // only when something fails
+        struct location
+        {
+            const location *parent;
+            std::string_view key;
+            size_t index = none;
+        };
+
+        std::string pointerOf(const location *at)
+        {
+            if (!at)
+                return std::string();
+            std::string out = pointerOf(at->parent) + "/";
+            out += at->index == none ? escapeSegment(at->key) : std::to_string(at->index);
+            return out;
+        }
+
+        // checks a value already in memory against a node and everything
+        // below it. without an error to fill, as inside anyOf, failing
+        // branches cost no message
+        class tree_checker
+        {
+            const std::vector<schema_node> &nodes;
+            // containers entered on the way down. the checker recurses once
+            // per level, values deeper than a parse would accept are refused
+            // instead of running out of stack
+            mutable size_t depth = 0;
+            const size_t maxDepth = parse_options().maxDepth;
+
+            struct descent
+            {
+                size_t &depth;
+                explicit descent(size_t &d) : depth(++d) {}
+                ~descent() { --depth; }
+            };
+
+            static bool fail(schema_error *error, const location *at, std::string problem)
+            {
+                if (error)
+                {
+                    error->path = pointerOf(at);
+                    error->problem = std::move(problem);
+                }
+                return false;
+            }
+
+            bool checkNumber(const schema_node &node, const json &value, const location *at, schema_error *error) const
+            {
+                if (node.minimum.isNumber() && compareNumbers(value, node.minimum) < 0)
+                    return fail(error, at, "number is below the minimum");
+                if (node.maximum.isNumber() && compareNumbers(value, node.maximum) > 0)
+                    return fail(error, at, "number is above the maximum");
+                if (node.exclusiveMinimum.isNumber() && compareNumbers(value, node.exclusiveMinimum) <= 0)
+                    return fail(error, at, "number is not above the exclusive minimum");
+                if (node.exclusiveMaximum.isNumber() && compareNumbers(value, node.exclusiveMaximum) >= 0)
+                    return fail(error, at, "number is not below the exclusive maximum");
+                if (node.multipleOf.isNumber())
+                {
+                    bool multiple;
+                    if (value.isInteger() && node.multipleOf.isInteger())
+                    {
+                        // the magnitude of the smallest long long still fits unsigned
+                        unsigned long long magnitude = value.get<double>() < 0 ? 0 - static_cast<unsigned long long>(value.get<long long>()) : value.get<unsigned long long>();
+                        multiple = magnitude % node.multipleOf.get<unsigned long long>() == 0;
+                    }
+                    else
+                    {
+                        double quotient = value.get<double>() / node.multipleOf.get<double>();
+                        multiple = std::fabs(quotient - std::round(quotient)) <= 1e-9 * std::max(1.0, std::fabs(quotient));
+                    }
+                    if (!multiple)
+                        return fail(error, at, "number is not a multiple of " + print(node.multipleOf));
+                }
+                return true;
+            }
+
+            bool checkString(const schema_node &node, std::string_view s, const location *at, schema_error *error) const
+            {
+                if (node.minLength > 0 || node.maxLength != none)
+                {
+                    size_t length = codePoints(s);
+                    if (length < node.minLength)
+                        return fail(error, at, "string is shorter than " + std::to_string(node.minLength));
+                    if (node.maxLength != none && length > node.maxLength)
+                        return fail(error, at, "string is longer than " + std::to_string(node.maxLength));
+                }
+                if (node.pattern && !std::regex_search(s.begin(), s.end(), *node.pattern))
+                    return fail(error, at, "string does not match " + node.patternText);
+                return true;
+            }
+
+            bool checkCollection(const schema_node &node, const json &value, const location *at, schema_error *error) const
+            {
+                auto [elements, size] = node_access::elements(value);
+                if (size < node.minItems)
+                    return fail(error, at, "array has fewer than " + std::to_string(node.minItems) + " items");
+                if (node.maxItems != none && size > node.maxItems)
+                    return fail(error, at, "array has more than " + std::to_string(node.maxItems) + " items");
+                if (depth == maxDepth)
+                    return fail(error, at, "value nests deeper than the maximum depth");
+                descent down(depth);
+                for (size_t i = 0; i < size; ++i)
+                {
+                    location here{at, std::string_view(), i};
+                    size_t element = elementNode(node, i);
+                    if (element != none && !check(element, elements[i], &here, error))
+                        return false;
+                }
+                if (node.uniqueItems)
+                {
+                    std::unordered_set<json> seen;
+                    for (size_t i = 0; i < size; ++i)
+                        if (!seen.insert(elements[i]).second)
+                            return fail(error, at, "array items are not unique");
+                }
+                if (node.contains != none)
+                {
+                    bool found = false;
+                    for (size_t i = 0; i < size && !found; ++i)
+                        found = check(node.contains, elements[i], nullptr, nullptr);
+                    if (!found)
+                        return fail(error, at, "array contains no matching item");
+                }
+                return true;
+            }
+
+            bool checkObject(const schema_node &node, const json &value, const location *at, schema_error *error) const
+            {
+                size_t size = node_access::memberCount(value);
+                if (size < node.minProperties)
+                    return fail(error, at, "object has fewer than " + std::to_string(node.minProperties) + " members");
+                if (node.maxProperties != none && size > node.maxProperties)
+                    return fail(error, at, "object has more than " + std::to_string(node.maxProperties) + " members");
+                if (depth == maxDepth)
+                    return fail(error, at, "value nests deeper than the maximum depth");
+                descent down(depth);
+                for (const std::string &name : node.required)
+                    if (!node_access::findMember(value, name))
+                        return fail(error, at, "required member is missing : " + name);
+                for (const auto &[name, needed] : node.requiredDependencies)
+                    if (node_access::findMember(value, name))
+                        for (const std::string &other : needed)
+                            if (!node_access::findMember(value, other))
+                                return fail(error, at, "member " + name + " requires member " + other);
+                for (const auto &[name, dependency] : node.schemaDependencies)
+                    if (node_access::findMember(value, name) && !check(dependency, value, at, error))
+                        return false;
+                bool ok = true;
+                node_access::forEachMember(value, [&](std::string_view key, const json &member)
+                                           {
+                                               if (!ok)
+                                                   return;
+                                               location here{at, key};
+                                               if (node.propertyNames != none && !check(node.propertyNames, node_access::borrowedString(key.data(), key.size()), &here, error))
+                                               {
+                                                   ok = false;
+                                                   return;
+                                               }
+                                               forEachMemberNode(node, key, [&](size_t member_node)
+                                                                 { ok = ok && check(member_node, member, &here, error); }); });
+                return ok;
+            }
+
+        public:
+            explicit tree_checker(const std::vector<schema_node> &n) : nodes(n) {}
+
+            // node of the element at position i, none when it is not checked
+            static size_t elementNode(const schema_node &node, size_t i)
+            {
+                if (!node.tuple)
+                    return node.items;
+                return i < node.tupleItems.size() ? node.tupleItems[i] : node.additionalItems;
+            }
+
+            // every node the member named key is checked against
+            template <typename functionT>
+            static void forEachMemberNode(const schema_node &node, std::string_view key, functionT &&function)
+            {
+                bool matched = false;
+                if (size_t property = node.property(key); property != none)
+                {
+                    matched = true;
+                    function(property);
+                }
+                for (const auto &[pattern, patternNode] : node.patternProperties)
+                    if (std::regex_search(key.begin(), key.end(), pattern))
+                    {
+                        matched = true;
+                        function(patternNode);
+                    }
+                if (!matched && node.additionalProperties != none)
+                    function(node.additionalProperties);
+            }
+
+            // what applies to any value, the rest is left to the caller
+            bool checkShallow(size_t n, const json &value, const location *at, schema_error *error) const
+            {
+                const schema_node &node = nodes[n];
+                if (node.rejectAll)
+                    return fail(error, at, "no value is allowed here");
+                unsigned bit = typeBit(value);
+                if (!(node.types & bit))
+                    return fail(error, at, "value is " + typeNames(bit) + ", expected " + typeNames(node.types));
+                if (node.hasConst && !(value == node.constant))
+                    return fail(error, at, "value is not the constant");
+                if (node.hasEnum && std::find(node.enumeration.begin(), node.enumeration.end(), value) == node.enumeration.end())
+                    return fail(error, at, "value is not one of the enumerated values");
+                if (bit & (integerBit | fractionBit))
+                    return checkNumber(node, value, at, error);
+                if (bit == stringBit)
+                    return checkString(node, node_access::string(value), at, error);
+                return true;
+            }
+
+            bool checkCombinators(const schema_node &node, const json &value, const location *at, schema_error *error) const
+            {
+                for (size_t sub : node.allOf)
+                    if (!check(sub, value, at, error))
+                        return false;
+                if (!node.anyOf.empty() && std::none_of(node.anyOf.begin(), node.anyOf.end(), [&](size_t sub)
+                                                        { return check(sub, value, nullptr, nullptr); }))
+                    return fail(error, at, "value matches none of anyOf");
+                if (!node.oneOf.empty() && std::count_if(node.oneOf.begin(), node.oneOf.end(), [&](size_t sub)
+                                                         { return check(sub, value, nullptr, nullptr); }) != 1)
+                    return fail(error, at, "value does not match exactly one of oneOf");
+                if (node.negated != none && check(node.negated, value, nullptr, nullptr))
+                    return fail(error, at, "value matches the schema under not");
+                if (node.condition != none)
+                {
+                    size_t branch = check(node.condition, value, nullptr, nullptr) ? node.then : node.otherwise;
+                    if (branch != none && !check(branch, value, at, error))
+                        return false;
+                }
+                return true;
+            }
+
+            bool check(size_t n, const json &value, const location *at, schema_error *error) const
+            {
+                const schema_node &node = nodes[n];
+                if (node.reference != none && !check(node.reference, value, at, error))
+                    return false;
+                if (!checkShallow(n, value, at, error))
+                    return false;
+                if (value.isCollection() && !checkCollection(node, value, at, error))
+                    return false;
+                if (value.isObject() && !checkObject(node, value, at, error))
+                    return false;
+                return checkCombinators(node, value, at, error);
+            }
+        };
+
+        // thrown by the stream checker to stop the parser at the first problem
+        struct rejected
+        {
+        };
+
+        // parser handler checking the document while it is read. every open
+        // container keeps the nodes it is checked against, a member or
+        // element is routed to the nodes of its key or position, and a value
+        // under a node that needs it whole is built and checked on the tree
+        class stream_checker
+        {
+            const std::vector<schema_node> &nodes;
+            tree_checker tree;
+            schema_error *error;
+
+            struct frame
+            {
+                bool object = false;
+                // the nodes of the container, references and allOf expanded
+                std::vector<size_t> nodes;
+                // the nodes of the value that comes next
+                std::vector<size_t> next;
+                size_t count = 0;
+                std::string_view key;
+                // keys seen so far, only kept when required members are asked for
+                bool keepKeys = false;
+                std::vector<std::string_view> keys;
+            };
+            std::vector<frame> frames;
+            size_t depth = 0;
+            std::vector<size_t> rootNodes;
+            std::vector<size_t> scratch;
+
+            dom_builder builder{parse_options()};
+            size_t capture = 0;
+            std::vector<size_t> captured;
+
+            std::string path(size_t levels) const
+            {
+                std::string out;
+                for (size_t i = 0; i < levels; ++i)
+                    out += "/" + (frames[i].object ? escapeSegment(frames[i].key) : std::to_string(frames[i].count - 1));
+                return out;
+            }
+
+            // stops the parse, levels is how many open containers lead to
+            // the value and inner the path of what failed inside it
+            [[noreturn]] void reject(size_t levels, std::string problem, const std::string &inner = std::string())
+            {
+                if (error)
+                {
+                    error->path = path(levels) + inner;
+                    error->problem = std::move(problem);
+                }
+                throw rejected();
+            }
+
+            void expand(size_t n, std::vector<size_t> &out) const
+            {
+                if (std::find(out.begin(), out.end(), n) != out.end())
+                    return;
+                out.push_back(n);
+                if (nodes[n].reference != none)
+                    expand(nodes[n].reference, out);
+                for (size_t sub : nodes[n].allOf)
+                    expand(sub, out);
+            }
+
+            // the nodes of the value about to start, none when unchecked
+            const std::vector<size_t> &nextNodes()
+            {
+                if (depth == 0)
+                    return rootNodes;
+                frame &top = frames[depth - 1];
+                if (top.object)
+                    return top.next;
+                scratch.clear();
+                for (size_t n : top.nodes)
+                    if (size_t element = tree_checker::elementNode(nodes[n], top.count); element != none)
+                        scratch.push_back(element);
+                ++top.count;
+                return scratch;
+            }
+
+            void scalar(const json &value)
+            {
+                if (capture)
+                    return;
+                const std::vector<size_t> &list = nextNodes();
+                schema_error inner;
+                for (size_t n : list)
+                    if (!tree.check(n, value, nullptr, error ? &inner : nullptr))
+                        reject(depth, inner.problem);
+            }
+
+            // false when the container is built and checked whole instead
+            bool open(bool object)
+            {
+                const std::vector<size_t> &list = nextNodes();
+                bool whole = false;
+                for (size_t n : list)
+                    whole = whole || nodes[n].wholeValue;
+                std::vector<size_t> expanded;
+                if (!whole)
+                {
+                    for (size_t n : list)
+                        expand(n, expanded);
+                    for (size_t n : expanded)
+                        whole = whole || nodes[n].wholeValue;
+                }
+                if (whole)
+                {
+                    captured = list;
+                    capture = 1;
+                    return false;
+                }
+                unsigned bit = object ? objectBit : collectionBit;
+                for (size_t n : expanded)
+                {
+                    if (nodes[n].rejectAll)
+                        reject(depth, "no value is allowed here");
+                    if (!(nodes[n].types & bit))
+                        reject(depth, "value is " + typeNames(bit) + ", expected " + typeNames(nodes[n].types));
+                }
+                if (depth == frames.size())
+                    frames.emplace_back();
+                frame &f = frames[depth++];
+                f.object = object;
+                f.nodes = std::move(expanded);
+                f.count = 0;
+                f.keys.clear();
+                f.keepKeys = false;
+                for (size_t n : f.nodes)
+                    f.keepKeys = f.keepKeys || !nodes[n].required.empty();
+                return true;
+            }
+
+            // a captured value that just closed is checked whole
+            void closeCaptured()
+            {
+                json value = builder.result();
+                schema_error inner;
+                for (size_t n : captured)
+                    if (!tree.check(n, value, nullptr, error ? &inner : nullptr))
+                        reject(depth, inner.problem, inner.path);
+            }
+
+        public:
+            stream_checker(const std::vector<schema_node> &n, schema_error *e) : nodes(n), tree(n), error(e), rootNodes{0} {}
+
+            void onNull()
+            {
+                if (capture)
+                    return builder.onNull();
+                scalar(json());
+            }
+
+            void onBool(bool value)
+            {
+                if (capture)
+                    return builder.onBool(value);
+                scalar(json(value));
+            }
+
+            void onInteger(long long value)
+            {
+                if (capture)
+                    return builder.onInteger(value);
+                scalar(json(value));
+            }
+
+            void onUnsigned(unsigned long long value)
+            {
+                if (capture)
+                    return builder.onUnsigned(value);
+                scalar(json(value));
+            }
+
+            void onNumber(double value)
+            {
+                if (capture)
+                    return builder.onNumber(value);
+                scalar(json(value));
+            }
+
+            void onString(std::string_view s)
+            {
+                if (capture)
+                    return builder.onString(s);
+                scalar(node_access::borrowedString(s.data(), s.size()));
+            }
+
+            void onKey(std::string_view key)
+            {
+                if (capture)
+                    return builder.onKey(key);
+                frame &top = frames[depth - 1];
+                top.key = key;
+                ++top.count;
+                if (top.keepKeys)
+                    top.keys.push_back(key);
+                top.next.clear();
+                for (size_t n : top.nodes)
+                {
+                    const schema_node &node = nodes[n];
+                    if (node.propertyNames != none)
+                    {
+                        schema_error inner;
+                        if (!tree.check(node.propertyNames, node_access::borrowedString(key.data(), key.size()), nullptr, error ? &inner : nullptr))
+                            reject(depth, "member name : " + inner.problem);
+                    }
+                    tree_checker::forEachMemberNode(node, key, [&](size_t member)
+                                                    { top.next.push_back(member); });
+                }
+            }
+
+            void onStartObject()
+            {
+                if (capture)
+                {
+                    ++capture;
+                    return builder.onStartObject();
+                }
+                if (!open(true))
+                    builder.onStartObject();
+            }
+
+            void onStartArray()
+            {
+                if (capture)
+                {
+                    ++capture;
+                    return builder.onStartArray();
+                }
+                if (!open(false))
+                    builder.onStartArray();
+            }
+
+            void onEndObject()
+            {
+                if (capture)
+                {
+                    builder.onEndObject();
+                    if (--capture == 0)
+                        closeCaptured();
+                    return;
+                }
+                frame &top = frames[depth - 1];
+                for (size_t n : top.nodes)
+                {
+                    const schema_node &node = nodes[n];
+                    if (top.count < node.minProperties)
+                        reject(depth - 1, "object has fewer than " + std::to_string(node.minProperties) + " members");
+                    if (node.maxProperties != none && top.count > node.maxProperties)
+                        reject(depth - 1, "object has more than " + std::to_string(node.maxProperties) + " members");
+                    for (const std::string &name : node.required)
+                        if (std::find(top.keys.begin(), top.keys.end(), name) == top.keys.end())
+                            reject(depth - 1, "required member is missing : " + name);
+                }
+                --depth;
+            }
+
+            void onEndArray()
+            {
+                if (capture)
+                {
+                    builder.onEndArray();
+                    if (--capture == 0)
+                        closeCaptured();
+                    return;
+                }
+                frame &top = frames[depth - 1];
+                for (size_t n : top.nodes)
+                {
+                    const schema_node &node = nodes[n];
+                    if (top.count < node.minItems)
+                        reject(depth - 1, "array has fewer than " + std::to_string(node.minItems) + " items");
+                    if (node.maxItems != none && top.count > node.maxItems)
+                        reject(depth - 1, "array has more than " + std::to_string(node.maxItems) + " items");
+                }
+                --depth;
+            }
+        };
+    }
+
+    struct schema::program
+    {
+        std::vector<schema_node> nodes;
+    };
+
+    schema::schema(const json &document)
+    {
+        auto compiling = std::make_shared<program>();
+        schema_compiler(document, compiling->nodes).compile(document, "");
+        compiled = std::move(compiling);
+    }
+
+    bool schema::validate(const json &document) const
+    {
+        return tree_checker(compiled->nodes).check(0, document, nullptr, nullptr);
+    }
+
+    bool schema::validate(const json &document, schema_error &error) const
+    {
+        return tree_checker(compiled->nodes).check(0, document, nullptr, &error);
+    }
+
+    bool schema::validateText(std::string_view text) const
+    {
+        stream_checker checker(compiled->nodes, nullptr);
+        try
+        {
+            run(text.data(), text.size(), parse_options(), checker);
+        }
+        catch (const rejected &)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    bool schema::validateText(std::string_view text, schema_error &error) const
+    {
+        stream_checker checker(compiled->nodes, &error);
+        try
+        {
+            run(text.data(), text.size(), parse_options(), checker);
+        }
+        catch (const rejected &)
+        {
+            return false;
+        }
+        return true;
+    }
+}
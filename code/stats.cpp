@@ -0,0 +1,109 @@
+#include "stats.h"
+#include <mutex>
+#include <algorithm>
+
+namespace badge881::json
+{
+    namespace
+    {
+        thread_local statistics totals;
+        std::function<void(phase, const statistics &)> observer;
+#ifdef BADGE881_JSON_STATS
+        // the observer is running on this thread, its own calls are not recorded
+        thread_local bool notifying = false;
+        std::mutex sharing;
+#endif
+    }
+
+#ifdef BADGE881_JSON_STATS
+    namespace stats
+    {
+        thread_local statistics *current = nullptr;
+        thread_local size_t depth = 0;
+
+        scope::scope(phase p) : part(p), outer(!current && !notifying)
+        {
+            if (!outer)
+                return;
+            current = &figures;
+            depth = 0;
+            start = std::chrono::steady_clock::now();
+        }
+
+        scope::~scope()
+        {
+            if (!outer)
+                return;
+            figures.calls = 1;
+            figures.nanoseconds[size_t(part)] = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            current = nullptr;
+            totals += figures;
+            if (observer)
+            {
+                notifying = true;
+                observer(part, figures);
+                notifying = false;
+            }
+        }
+
+        share::share(statistics *p) : parent(p), previous(current), previousDepth(depth)
+        {
+            if (!parent)
+                return;
+            current = &figures;
+            depth = 0;
+        }
+
+        share::~share()
+        {
+            if (!parent)
+                return;
+            current = previous;
+            depth = previousDepth;
+            // every thread of the loop counts apart, the calling one
+            // included, and adds its figures when it is done
+            std::lock_guard<std::mutex> lock(sharing);
+            *parent += figures;
+        }
+    }
+#endif
+
+    statistics &statistics::operator+=(const statistics &other)
+    {
+        calls += other.calls;
+        bytesRead += other.bytesRead;
+        bytesWritten += other.bytesWritten;
+        for (size_t i = 0; i <= collectionType; ++i)
+            nodes[i] += other.nodes[i];
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        allocations += other.allocations;
+        allocatedBytes += other.allocatedBytes;
+        for (size_t i = 0; i < 3; ++i)
+            nanoseconds[i] += other.nanoseconds[i];
+        return *this;
+    }
+
+    bool statisticsEnabled()
+    {
+#ifdef BADGE881_JSON_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    const statistics &threadStatistics()
+    {
+        return totals;
+    }
+
+    void resetThreadStatistics()
+    {
+        totals = statistics();
+    }
+
+    void setStatisticsObserver(std::function<void(phase, const statistics &)> function)
+    {
+        observer = std::move(function);
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../include/json.h"
+#ifdef BADGE881_JSON_STATS
+#include <chrono>
+#endif
+
+// the hooks behind statistics. built without BADGE881_JSON_STATS they are
+// empty inline functions and types, nothing of them is left in the code
+namespace badge881::json::stats
+{
+#ifdef BADGE881_JSON_STATS
+    // the call recorded on this thread, null outside of one
+    extern thread_local statistics *current;
+    extern thread_local size_t depth;
+
+    // records one parse, print or copy. made inside another call it only
+    // adds to that one
+    class scope
+    {
+        statistics figures;
+        std::chrono::steady_clock::time_point start;
+        phase part;
+        bool outer;
+
+    public:
+        explicit scope(phase p);
+        scope(const scope &) = delete;
+        ~scope();
+    };
+
+    // lets the threads of a parallel loop count into the call of the
+    // thread that started it
+    class share
+    {
+        statistics *parent;
+        statistics *previous;
+        size_t previousDepth;
+        statistics figures;
+
+    public:
+        share(statistics *p);
+        share(const share &) = delete;
+        ~share();
+    };
+
+    inline statistics *shared()
+    {
+        return current;
+    }
+
+    inline void read(size_t bytes)
+    {
+        if (current)
+            current->bytesRead += bytes;
+    }
+
+    inline void wrote(size_t bytes)
+    {
+        if (current)
+            current->bytesWritten += bytes;
+    }
+
+    inline void node(type t)
+    {
+        if (current)
+            ++current->nodes[t];
+    }
+
+    inline void enter()
+    {
+        if (current && ++depth > current->maxDepth)
+            current->maxDepth = depth;
+    }
+
+    inline void leave()
+    {
+        if (current)
+            --depth;
+    }
+
+    inline void allocated(size_t bytes)
+    {
+        if (current)
+        {
+            ++current->allocations;
+            current->allocatedBytes += bytes;
+        }
+    }
+#else
+    struct scope
+    {
+        explicit scope(phase) {}
+    };
+
+    struct share
+    {
+        share(statistics *) {}
+    };
+
+    inline statistics *shared()
+    {
+        return nullptr;
+    }
+
+    inline void read(size_t) {}
+    inline void wrote(size_t) {}
+    inline void node(type) {}
+    inline void enter() {}
+    inline void leave() {}
+    inline void allocated(size_t) {}
+#endif
+}
@@ -0,0 +1,522 @@
+#include "strings.h"
+#include "structural.h"
+#include "../include/json.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BADGE881_JSON_X86
+#include <immintrin.h>
+#endif
+
+namespace badge881::json
+{
+    namespace
+    {
+        // the bytes a string cannot hold as they are : the quote, the
+        // backslash and the control characters
+        const std::array<bool, 256> special = []
+        {
+            std::array<bool, 256> table{};
+            for (int c = 0; c < 0x20; ++c)
+                table[c] = true;
+            table['"'] = true;
+            table['\\'] = true;
+            return table;
+        }();
+
+        // the first special byte from p on, or end. sets multibyte when a
+        // byte above ascii comes before it
+        const char *findSpecialScalar(const char *p, const char *end, bool &multibyte)
+        {
+            for (; p != end; ++p)
+            {
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (special[c])
+                    return p;
+                if (c & 0x80)
+                    multibyte = true;
+            }
+            return end;
+        }
+
+#ifdef BADGE881_JSON_X86
+        __attribute__((target("sse2"))) const char *findSpecialSse2(const char *p, const char *end, bool &multibyte)
+        {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1f);
+            // high bits are gathered without a branch, utf-8 text has them
+            // all over the place
+            unsigned seen = 0;
+            while (p != end)
+            {
+                // the last few bytes are copied out and padded with spaces,
+                // most strings are shorter than a vector
+                size_t size = size_t(end - p);
+                alignas(16) char tail[16];
+                const char *from = p;
+                if (size < 16)
+                {
+                    std::memset(tail, ' ', sizeof(tail));
+                    std::memcpy(tail, p, size);
+                    from = tail;
+                }
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from));
+                // unsigned bytes up to 0x1f are left unchanged by the max
+                __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                             _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+                unsigned specials = unsigned(_mm_movemask_epi8(found));
+                unsigned high = unsigned(_mm_movemask_epi8(chunk));
+                if (specials)
+                {
+                    unsigned at = unsigned(__builtin_ctz(specials));
+                    seen |= high & ((1u << at) - 1);
+                    multibyte |= seen != 0;
+                    return p + at;
+                }
+                seen |= high;
+                p += size < 16 ? size : 16;
+            }
+            multibyte |= seen != 0;
+            return end;
+        }
+
+        __attribute__((target("avx2"))) const char *findSpecialAvx2(const char *p, const char *end, bool &multibyte)
+        {
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i control = _mm256_set1_epi8(0x1f);
+            uint32_t seen = 0;
+            for (; end - p >= 32; p += 32)
+            {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                                                _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+                uint32_t specials = uint32_t(_mm256_movemask_epi8(found));
+                uint32_t high = uint32_t(_mm256_movemask_epi8(chunk));
+                if (specials)
+                {
+                    unsigned at = unsigned(__builtin_ctz(specials));
+                    seen |= high & ((uint32_t(1) << at) - 1);
+                    multibyte |= seen != 0;
+                    return p + at;
+                }
+                seen |= high;
+            }
+            multibyte |= seen != 0;
+            return findSpecialSse2(p, end, multibyte);
+        }
+
+        // the end of the run of ascii bytes from s on, 16 at a time
+        __attribute__((target("sse2"))) const unsigned char *skipAscii(const unsigned char *s, const unsigned char *end)
+        {
+            for (; end - s >= 16; s += 16)
+                if (unsigned high = unsigned(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)))))
+                    return s + __builtin_ctz(high);
+            while (s != end && *s < 0x80)
+                ++s;
+            return s;
+        }
+        // the lookup validation of Keiser and Lemire : every byte is checked
+        // against the one, two and three before it with three nibble tables
+        // and the errors of a block gathered in one vector
+        enum utf8_error : uint8_t
+        {
+            tooShort = 1 << 0,
+            tooLong = 1 << 1,
+            overlong3 = 1 << 2,
+            tooLarge = 1 << 3,
+            surrogate = 1 << 4,
+            overlong2 = 1 << 5,
+            // the same bit, each only meets its own pattern
+            tooLarge1000 = 1 << 6,
+            overlong4 = 1 << 6,
+            twoContinuations = 1 << 7,
+            carry = tooShort | tooLong | twoContinuations
+        };
+
+        template <int n>
+        __attribute__((target("avx2"))) inline __m256i previousBytes(__m256i input, __m256i previous)
+        {
+            return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - n);
+        }
+
+        __attribute__((target("avx2"))) inline __m256i highNibbles(__m256i bytes)
+        {
+            return _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0f));
+        }
+
+        __attribute__((target("avx2"))) __m256i utf8Errors(__m256i input, __m256i previous)
+        {
+            const __m256i firstHigh = _mm256_setr_epi8(
+                tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+                twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+                tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4,
+                tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+                twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+                tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4);
+            const __m256i firstLow = _mm256_setr_epi8(
+                carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry, carry,
+                carry | tooLarge, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+                carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+                carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000 | surrogate, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+                carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry, carry,
+                carry | tooLarge, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+                carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+                carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000 | surrogate, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000);
+            const __m256i secondHigh = _mm256_setr_epi8(
+                tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+                tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+                tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+                tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+                tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+                tooShort, tooShort, tooShort, tooShort,
+                tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+                tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+                tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+                tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+                tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+                tooShort, tooShort, tooShort, tooShort);
+            __m256i previous1 = previousBytes<1>(input, previous);
+            __m256i special = _mm256_and_si256(_mm256_and_si256(_mm256_shuffle_epi8(firstHigh, highNibbles(previous1)),
+                                                                _mm256_shuffle_epi8(firstLow, _mm256_and_si256(previous1, _mm256_set1_epi8(0x0f)))),
+                                               _mm256_shuffle_epi8(secondHigh, highNibbles(input)));
+            // the third and fourth bytes of a sequence, the only places two
+            // continuations in a row are allowed
+            __m256i third = _mm256_subs_epu8(previousBytes<2>(input, previous), _mm256_set1_epi8(char(0xe0 - 0x80)));
+            __m256i fourth = _mm256_subs_epu8(previousBytes<3>(input, previous), _mm256_set1_epi8(char(0xf0 - 0x80)));
+            __m256i continued = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+            return _mm256_xor_si256(continued, special);
+        }
+
+        __attribute__((target("avx2"))) bool validUtf8Avx2(const char *p, size_t size)
+        {
+            __m256i errors = _mm256_setzero_si256();
+            __m256i previous = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+                errors = _mm256_or_si256(errors, utf8Errors(input, previous));
+                previous = input;
+            }
+            // the rest is padded with zeros, which also ends a sequence cut
+            // short by the end of the string
+            alignas(32) char tail[32] = {};
+            std::memcpy(tail, p + i, size - i);
+            errors = _mm256_or_si256(errors, utf8Errors(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail)), previous));
+            return _mm256_testz_si256(errors, errors);
+        }
+#else
+        const unsigned char *skipAscii(const unsigned char *s, const unsigned char *end)
+        {
+            while (s != end && *s < 0x80)
+                ++s;
+            return s;
+        }
+#endif
+
+        bool validUtf8Scalar(const char *p, size_t size)
+        {
+            const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+            const unsigned char *end = s + size;
+            while ((s = skipAscii(s, end)) != end)
+            {
+                unsigned char c = *s;
+                size_t length;
+                uint32_t code, least;
+                if ((c & 0xe0) == 0xc0)
+                {
+                    length = 2;
+                    code = c & 0x1f;
+                    least = 0x80;
+                }
+                else if ((c & 0xf0) == 0xe0)
+                {
+                    length = 3;
+                    code = c & 0x0f;
+                    least = 0x800;
+                }
+                else if ((c & 0xf8) == 0xf0)
+                {
+                    length = 4;
+                    code = c & 0x07;
+                    least = 0x10000;
+                }
+                else
+                    return false;
+                if (size_t(end - s) < length)
+                    return false;
+                for (size_t i = 1; i < length; ++i)
+                {
+                    if ((s[i] & 0xc0) != 0x80)
+                        return false;
+                    code = code << 6 | (s[i] & 0x3f);
+                }
+                // overlong forms, surrogates and code points past unicode
+                if (code < least || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff))
+                    return false;
+                s += length;
+            }
+            return true;
+        }
+
+        using finder = const char *(*)(const char *, const char *, bool &);
+
+        finder pickFinder()
+        {
+            switch (detectInstructionSet())
+            {
+#ifdef BADGE881_JSON_X86
+            case instruction_set::avx2:
+                return findSpecialAvx2;
+            case instruction_set::sse2:
+                return findSpecialSse2;
+#endif
+            default:
+                return findSpecialScalar;
+            }
+        }
+
+        const char *findSpecial(const char *p, const char *end, bool &multibyte)
+        {
+            static const finder best = pickFinder();
+            return best(p, end, multibyte);
+        }
+
+        uint32_t readHex(const char *&p, const char *end)
+        {
+            if (end - p < 4)
+                throw json::read_error("invalid json input : invalid escape");
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = *p++;
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                    value |= uint32_t(c - '0');
+                else if (c >= 'a' && c <= 'f')
+                    value |= uint32_t(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F')
+                    value |= uint32_t(c - 'A' + 10);
+                else
+                    throw json::read_error("invalid json input : invalid escape");
+            }
+            return value;
+        }
+
+        char *encodeUtf8(uint32_t code, char *out)
+        {
+            if (code < 0x80)
+                *out++ = char(code);
+            else if (code < 0x800)
+            {
+                *out++ = char(0xc0 | code >> 6);
+                *out++ = char(0x80 | (code & 0x3f));
+            }
+            else if (code < 0x10000)
+            {
+                *out++ = char(0xe0 | code >> 12);
+                *out++ = char(0x80 | (code >> 6 & 0x3f));
+                *out++ = char(0x80 | (code & 0x3f));
+            }
+            else
+            {
+                *out++ = char(0xf0 | code >> 18);
+                *out++ = char(0x80 | (code >> 12 & 0x3f));
+                *out++ = char(0x80 | (code >> 6 & 0x3f));
+                *out++ = char(0x80 | (code & 0x3f));
+            }
+            return out;
+        }
+    }
+
+    const char *findStringEnd(const char *p, const char *end, unsigned &content)
+    {
+        bool multibyte = false;
+        while ((p = findSpecial(p, end, multibyte)) != end && *p != '"')
+            if (*p == '\\')
+            {
+                // the escaped character is skipped, a quote included
+                content |= hasEscapes;
+                p = end - p > 2 ? p + 2 : end;
+            }
+            else
+            {
+                content |= hasControls;
+                ++p;
+            }
+        if (multibyte)
+            content |= hasMultibyte;
+        return p;
+    }
+
+    unsigned classifyString(const char *p, size_t size)
+    {
+        unsigned content = 0;
+        const char *end = p + size;
+        bool multibyte = false;
+        while ((p = findSpecial(p, end, multibyte)) != end)
+            if (*p == '\\')
+            {
+                content |= hasEscapes;
+                p = end - p > 2 ? p + 2 : end;
+            }
+            else
+            {
+                // only an escaped quote can be inside, the backslash has
+                // already skipped it
+                content |= hasControls;
+                ++p;
+            }
+        if (multibyte)
+            content |= hasMultibyte;
+        return content;
+    }
+
+    bool isValidUtf8(const char *p, size_t size)
+    {
+#ifdef BADGE881_JSON_X86
+        static const bool vectors = detectInstructionSet() == instruction_set::avx2;
+        if (vectors)
+            return validUtf8Avx2(p, size);
+#endif
+        return validUtf8Scalar(p, size);
+    }
+
+    void checkString(const char *p, size_t size, unsigned content)
+    {
+        if (content & hasControls)
+            throw json::read_error("invalid json input : control character in string");
+        if ((content & hasMultibyte) && !isValidUtf8(p, size))
+            throw json::read_error("invalid json input : invalid utf-8 in string");
+    }
+
+    char *decodeEscapes(const char *p, size_t size, char *out)
+    {
+        const char *end = p + size;
+        while (true)
+        {
+            const char *backslash = static_cast<const char *>(std::memchr(p, '\\', size_t(end - p)));
+            const char *stop = backslash ? backslash : end;
+            std::memmove(out, p, size_t(stop - p));
+            out += stop - p;
+            if (!backslash)
+                return out;
+            p = backslash + 1;
+            if (p == end)
+                throw json::read_error("invalid json input : invalid escape");
+            switch (*p++)
+            {
+            case '"':
+                *out++ = '"';
+                break;
+            case '\\':
+                *out++ = '\\';
+                break;
+            case '/':
+                *out++ = '/';
+                break;
+            case 'b':
+                *out++ = '\b';
+                break;
+            case 'f':
+                *out++ = '\f';
+                break;
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 'r':
+                *out++ = '\r';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case 'u':
+            {
+                uint32_t code = readHex(p, end);
+                if (code >= 0xd800 && code <= 0xdbff)
+                {
+                    // a high surrogate has to be followed by a low one
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                        throw json::read_error("invalid json input : lone surrogate in string");
+                    p += 2;
+                    uint32_t low = readHex(p, end);
+                    if (low < 0xdc00 || low > 0xdfff)
+                        throw json::read_error("invalid json input : lone surrogate in string");
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (code >= 0xdc00 && code <= 0xdfff)
+                    throw json::read_error("invalid json input : lone surrogate in string");
+                out = encodeUtf8(code, out);
+                break;
+            }
+            default:
+                throw json::read_error("invalid json input : invalid escape");
+            }
+        }
+    }
+
+    void appendQuoted(std::string &out, std::string_view s)
+    {
+        static const char digits[] = "0123456789abcdef";
+        // room for the string as it is, grown by five bytes for each
+        // character written as a \u escape
+        size_t at = out.size();
+        out.resize(at + s.size() + 2);
+        char *w = &out[at];
+        *w++ = '"';
+        const char *p = s.data();
+        const char *end = p + s.size();
+        bool multibyte = false;
+        while (true)
+        {
+            // the runs in between are copied whole
+            const char *stop = findSpecial(p, end, multibyte);
+            // p is null for an empty view
+            if (stop != p)
+                std::memcpy(w, p, size_t(stop - p));
+            w += stop - p;
+            if (stop == end)
+                break;
+            size_t written = size_t(w - out.data());
+            out.resize(out.size() + 5);
+            w = &out[written];
+            *w++ = '\\';
+            unsigned char c = static_cast<unsigned char>(*stop);
+            switch (c)
+            {
+            case '"':
+            case '\\':
+                *w++ = char(c);
+                break;
+            case '\b':
+                *w++ = 'b';
+                break;
+            case '\f':
+                *w++ = 'f';
+                break;
+            case '\n':
+                *w++ = 'n';
+                break;
+            case '\r':
+                *w++ = 'r';
+                break;
+            case '\t':
+                *w++ = 't';
+                break;
+            default:
+                *w++ = 'u';
+                *w++ = '0';
+                *w++ = '0';
+                *w++ = digits[c >> 4];
+                *w++ = digits[c & 15];
+            }
+            p = stop + 1;
+        }
+        *w++ = '"';
+        out.resize(size_t(w - out.data()));
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// the strings of json text : where they end, whether their bytes are well
+// formed, their escapes decoded on the way in and written on the way out
+namespace badge881::json
+{
+    // what the content of a string holds besides plain ascii
+    enum string_content : unsigned
+    {
+        hasEscapes = 1,
+        hasMultibyte = 2,
+        hasControls = 4
+    };
+
+    // p is just past the opening quote. returns the closing quote, or end
+    // when the string is not closed, and adds what it passed to content
+    const char *findStringEnd(const char *p, const char *end, unsigned &content);
+
+    // what the content of a string already delimited holds
+    unsigned classifyString(const char *p, size_t size);
+
+    bool isValidUtf8(const char *p, size_t size);
+
+    // throws read_error on control characters and malformed utf-8
+    void checkString(const char *p, size_t size, unsigned content);
+
+    // writes the content with its escapes decoded to out, which has room
+    // for size bytes as decoding never makes a string longer, and may be p
+    // itself. returns the end of what was written, throws read_error on a
+    // malformed escape
+    char *decodeEscapes(const char *p, size_t size, char *out);
+
+    // appends s between quotes, with quotes, backslashes and control
+    // characters escaped
+    void appendQuoted(std::string &out, std::string_view s);
+
+    // the content of a string checked and decoded. plain content is
+    // returned in place, space(size) is only asked for when there are
+    // escapes to decode
+    template <typename spaceT>
+    std::string_view decodeString(const char *p, size_t size, unsigned content, spaceT &&space)
+    {
+        if (!content)
+            return std::string_view(p, size);
+        checkString(p, size, content);
+        if (!(content & hasEscapes))
+            return std::string_view(p, size);
+        char *out = space(size);
+        return std::string_view(out, size_t(decodeEscapes(p, size, out) - out));
+    }
+}
@@ -0,0 +1,224 @@
+#include "structural.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BADGE881_JSON_X86
+#include <immintrin.h>
+#endif
+
+namespace badge881::json
+{
+    namespace
+    {
+        // bit masks for one 64 byte block, bit i is byte i
+        struct block
+        {
+            uint64_t backslash;
+            uint64_t quote;
+            uint64_t whitespace;
+            uint64_t op;
+        };
+
+        void classifyScalar(const char *in, block &b)
+        {
+            b = {0, 0, 0, 0};
+            for (int i = 0; i < 64; ++i)
+            {
+                uint64_t bit = uint64_t(1) << i;
+                switch (in[i])
+                {
+                case '\\':
+                    b.backslash |= bit;
+                    break;
+                case '"':
+                    b.quote |= bit;
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    b.whitespace |= bit;
+                    break;
+                case '{':
+                case '}':
+                case '[':
+                case ']':
+                case ':':
+                case ',':
+                    b.op |= bit;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+#ifdef BADGE881_JSON_X86
+        __attribute__((target("sse2"))) inline uint64_t equal16(__m128i chunk, char c)
+        {
+            return uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))));
+        }
+
+        __attribute__((target("sse2"))) void classifySse2(const char *in, block &b)
+        {
+            b = {0, 0, 0, 0};
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i));
+                int shift = 16 * i;
+                b.backslash |= equal16(chunk, '\\') << shift;
+                b.quote |= equal16(chunk, '"') << shift;
+                b.whitespace |= (equal16(chunk, ' ') | equal16(chunk, '\t') | equal16(chunk, '\n') | equal16(chunk, '\r')) << shift;
+                b.op |= (equal16(chunk, '{') | equal16(chunk, '}') | equal16(chunk, '[') | equal16(chunk, ']') | equal16(chunk, ':') | equal16(chunk, ',')) << shift;
+            }
+        }
+
+        __attribute__((target("avx2"))) inline uint64_t equal32(__m256i chunk, char c)
+        {
+            return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c))));
+        }
+
+        __attribute__((target("avx2"))) void classifyAvx2(const char *in, block &b)
+        {
+            b = {0, 0, 0, 0};
+            for (int i = 0; i < 2; ++i)
+            {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32 * i));
+                int shift = 32 * i;
+                b.backslash |= equal32(chunk, '\\') << shift;
+                b.quote |= equal32(chunk, '"') << shift;
+                b.whitespace |= (equal32(chunk, ' ') | equal32(chunk, '\t') | equal32(chunk, '\n') | equal32(chunk, '\r')) << shift;
+                b.op |= (equal32(chunk, '{') | equal32(chunk, '}') | equal32(chunk, '[') | equal32(chunk, ']') | equal32(chunk, ':') | equal32(chunk, ',')) << shift;
+            }
+        }
+#endif
+
+        inline uint64_t prefixXor(uint64_t bits)
+        {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
+        }
+
+        // state carried from one block to the next
+        struct scanner
+        {
+            uint64_t prevEscaped = 0;
+            uint64_t prevInString = 0;
+            uint64_t prevScalar = 0;
+
+            uint64_t structurals(const block &b)
+            {
+                // characters escaped by an odd run of backslashes
+                uint64_t backslash = b.backslash & ~prevEscaped;
+                uint64_t followsEscape = backslash << 1 | prevEscaped;
+                const uint64_t evenBits = 0x5555555555555555ULL;
+                uint64_t oddStarts = backslash & ~evenBits & ~followsEscape;
+                uint64_t evenStarts = oddStarts + backslash;
+                prevEscaped = evenStarts < oddStarts ? 1 : 0;
+                uint64_t escaped = (evenBits ^ (evenStarts << 1)) & followsEscape;
+
+                uint64_t quote = b.quote & ~escaped;
+                // set from an opening quote up to, not including, its closing quote
+                uint64_t inString = prefixXor(quote) ^ prevInString;
+                prevInString = uint64_t(int64_t(inString) >> 63);
+
+                uint64_t scalar = ~(b.op | b.whitespace | quote) & ~inString;
+                uint64_t scalarStart = scalar & ~(scalar << 1 | prevScalar);
+                prevScalar = scalar >> 63;
+
+                return (b.op & ~inString) | quote | scalarStart;
+            }
+        };
+
+        // writes the offsets of the set bits, eight at a time without
+        // branching on the count, the index always keeps 64 spare slots
+        inline void flatten(uint64_t bits, uint32_t base, std::vector<uint32_t> &index, size_t &count)
+        {
+            if (index.size() < count + 64)
+                index.resize(index.size() * 2 + 64);
+            uint32_t *out = index.data() + count;
+            count += size_t(__builtin_popcountll(bits));
+            while (bits)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    out[i] = base + uint32_t(__builtin_ctzll(bits | (uint64_t(1) << 63)));
+                    bits &= bits - 1;
+                }
+                out += 8;
+            }
+        }
+
+        template <void (*classify)(const char *, block &)>
+        void build(const char *data, size_t size, std::vector<uint32_t> &index)
+        {
+            scanner s;
+            block b;
+            size_t count = 0;
+            size_t offset = 0;
+            index.resize(size / 8 + 64);
+            for (; offset + 64 <= size; offset += 64)
+            {
+                classify(data + offset, b);
+                flatten(s.structurals(b), uint32_t(offset), index, count);
+            }
+            if (offset < size)
+            {
+                // pad the tail with whitespace, it cannot create structurals
+                char tail[64];
+                std::memset(tail, ' ', sizeof(tail));
+                std::memcpy(tail, data + offset, size - offset);
+                classify(tail, b);
+                flatten(s.structurals(b), uint32_t(offset), index, count);
+            }
+            index.resize(count);
+        }
+    }
+
+    instruction_set detectInstructionSet()
+    {
+#ifdef BADGE881_JSON_X86
+        static const instruction_set best = []
+        {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return instruction_set::avx2;
+            if (__builtin_cpu_supports("sse2"))
+                return instruction_set::sse2;
+            return instruction_set::scalar;
+        }();
+        return best;
+#else
+        return instruction_set::scalar;
+#endif
+    }
+
+    void buildStructuralIndex(const char *data, size_t size, std::vector<uint32_t> &index, instruction_set set)
+    {
+        index.clear();
+        switch (set)
+        {
+#ifdef BADGE881_JSON_X86
+        case instruction_set::avx2:
+            build<classifyAvx2>(data, size, index);
+            return;
+        case instruction_set::sse2:
+            build<classifySse2>(data, size, index);
+            return;
+#endif
+        default:
+            build<classifyScalar>(data, size, index);
+            return;
+        }
+    }
+
+    void buildStructuralIndex(const char *data, size_t size, std::vector<uint32_t> &index)
+    {
+        buildStructuralIndex(data, size, index, detectInstructionSet());
+    }
+}
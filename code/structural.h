@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace badge881::json
+{
+    enum class instruction_set
+    {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    // best instruction set the running cpu supports, detected once
+    instruction_set detectInstructionSet();
+
+    // stage one of the parser : records the offset of every character the
+    // parser has to stop at, that is braces, brackets, colons, commas, both
+    // quotes of every string and the first character of every other token
+    // outside of strings, 64 bytes at a time
+    void buildStructuralIndex(const char *data, size_t size, std::vector<uint32_t> &index, instruction_set set);
+    void buildStructuralIndex(const char *data, size_t size, std::vector<uint32_t> &index);
+}
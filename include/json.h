@@ -1,135 +1,1116 @@
-#pragma once
-
-#include <vector>
-#include <unordered_map>
-#include <string>
-#include <initializer_list>
-#include <iostream>
-
-namespace badge881::json
-{
-    enum type
-    {
-        nullType,
-        booleanType,
-        numberType,
-        stringType,
-        objectType,
-        collectionType
-    };
-
-    class json;
-
-    typedef std::initializer_list<std::pair<std::string, json>> object;
-    typedef std::initializer_list<json> collection;
-
-    json parse(std::istream&);
-    
-    json parseFile(std::string);
-
-    json parse(std::string);
-
-    std::istream &operator>>(std::istream &, json &);
-    
-    std::string print(const json&);
-    
-    void printFile(const json&, const std::string&);
-    
-    std::ostream &operator<<(std::ostream &, const json &);
-    
-    class json
-    {
-        
-        type typeName = nullType;
-
-        std::nullptr_t dataForNull = nullptr;
-        bool dataForBoolean = false;
-        double dataForNum = 0.0;
-        std::string dataForString = "";
-        std::vector<json> dataForCollection = {};
-        std::unordered_map<std::string, json> dataForObject = {};
-        
-        public:
-        json();
-        json(const json &);
-        json(json &&);
-        json(const type &);
-        json(const std::string &);
-        json(const char*);
-        json(bool);
-        json(double);
-        json(int);
-        json(unsigned int);
-        json(long long);
-        json(unsigned long long);
-        json(collection);
-        json(object);
-        json(std::vector<json>);
-        json(std::unordered_map<std::string, json>);
-        
-        json &operator=(const type &);
-        json &operator=(const json &);
-        json &operator=(json &&);
-        json &operator=(const std::string &);
-        json &operator=(bool);
-        json &operator=(double);
-        json &operator=(int);
-        json &operator=(unsigned int);
-        json &operator=(long long);
-        json &operator=(unsigned long long);
-        json &operator=(collection);
-        json &operator=(object);
-        json &operator=(std::vector<json>);
-        json &operator=(std::unordered_map<std::string, json>);
-        
-        ~json();
-        void clear();
-        
-        class type_error : public std::exception
-        {
-            std::string problem;
-            
-            public:
-            type_error(std::string p) : problem(p) {}
-            const char *what() const noexcept override { return problem.c_str(); }
-        };
-        class read_error : public std::exception
-        {
-            std::string problem;
-            
-            public:
-            read_error(std::string p) : problem(p) {}
-            const char *what() const noexcept override { return problem.c_str(); }
-        };
-
-        bool isNull() const;
-        bool isBoolean() const;
-        bool isNumber() const;
-        bool isString() const;
-        bool isObject() const;
-        bool isCollection() const;
-        
-        type getType() const;
-        std::string getTypeString() const;
-        
-        template <typename typeT>
-        typeT &get();
-        
-        json &operator[](const std::string &);
-        json &operator[](const int &);
-        
-        bool operator==(const json &) const;
-        bool operator!=(const json &) const;
-    };
-    json parse(std::string);
-    json parse(std::istream &);
-};
-
-template <>
-struct std::hash<badge881::json::json>
-{
-    size_t operator()(const badge881::json::json &) const noexcept;
-
-private:
-    void combine(size_t &, const size_t &) const noexcept;
-};
\ No newline at end of file
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <initializer_list>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <memory_resource>
+#include <memory>
+#include <functional>
+#include <tuple>
+#include <optional>
+#include <map>
+#include <type_traits>
+#include <limits>
+#include <array>
+#include <utility>
+
+namespace badge881::json
+{
+    enum type : unsigned char
+    {
+        nullType,
+        booleanType,
+        numberType,
+        stringType,
+        objectType,
+        collectionType
+    };
+
+    class json;
+    class node_access;
+    struct borrowed_member;
+    class flat_object;
+    class key_table;
+    struct key_atom;
+    class key_handle;
+    template <typename T>
+    struct counted;
+
+    typedef std::initializer_list<std::pair<std::string, json>> object;
+    typedef std::initializer_list<json> collection;
+
+    struct parse_options
+    {
+        // build a simd index of the structural characters before parsing so
+        // the parser can jump between tokens, pays off on whitespace and
+        // string heavy input, only used once the input spans a few blocks
+        bool structuralIndex = false;
+        size_t structuralIndexThreshold = 4096;
+        // when set every string and container of the document is allocated
+        // from this resource, which then has to outlive the document
+        std::pmr::memory_resource *resource = nullptr;
+        // with a resource, strings and keys are not copied but read straight
+        // from the input, which then has to outlive the document as well.
+        // those with escapes are decoded into the resource
+        bool borrowInput = false;
+        // other than one, a top level collection of at least parallelThreshold
+        // bytes is cut between its elements and parsed on that many threads,
+        // zero takes one per hardware thread. not used with a resource
+        unsigned threads = 1;
+        size_t parallelThreshold = 1 << 20;
+        // when set object keys are interned in this table and shared by all
+        // the documents parsed with it, which then has to outlive them
+        key_table *keys = nullptr;
+        // deeper nesting throws read_error. the parser keeps its own stack
+        // and could go on, this bounds the work hostile input can cause
+        size_t maxDepth = 1024;
+    };
+
+    // reads one value, the stream is left right after it
+    json parse(std::istream&);
+
+    json parseFile(std::string);
+
+    json parse(std::string_view);
+
+    json parse(const char *, size_t);
+
+    json parse(std::string_view, const parse_options &);
+
+    json parse(const char *, size_t, const parse_options &);
+
+    json parse(std::string_view, std::pmr::memory_resource &);
+
+    json parseFile(std::string, const parse_options &);
+
+    class arena;
+
+    // maps the file and parses it into the arena without copying a single
+    // string, the mapping stays open until the arena is released
+    json parseFile(std::string, arena &);
+
+    std::istream &operator>>(std::istream &, json &);
+
+    // receives a document as events in reading order instead of a tree, so
+    // memory only grows with the nesting depth. strings and keys come with
+    // their escapes decoded and are only valid during the call
+    class sax_handler
+    {
+        public:
+        virtual ~sax_handler() = default;
+
+        virtual void onNull() {}
+        virtual void onBool(bool) {}
+        // integers that fit 64 bits, both forward to onNumber by default
+        virtual void onInteger(long long value) { onNumber(static_cast<double>(value)); }
+        virtual void onUnsigned(unsigned long long value) { onNumber(static_cast<double>(value)); }
+        virtual void onNumber(double) {}
+        virtual void onString(std::string_view) {}
+        virtual void onKey(std::string_view) {}
+        virtual void onStartObject() {}
+        virtual void onEndObject() {}
+        virtual void onStartArray() {}
+        virtual void onEndArray() {}
+    };
+
+    void parse(std::string_view, sax_handler &);
+
+    void parse(const char *, size_t, sax_handler &);
+
+    void parseFile(std::string, sax_handler &);
+
+    struct line_options
+    {
+        // worker threads, zero takes one per hardware thread
+        unsigned threads = 0;
+        // the input is cut into chunks of about this size at line ends and
+        // each chunk parsed by one thread
+        size_t chunkSize = 1 << 20;
+        // shared by all threads, see parse_options::keys
+        key_table *keys = nullptr;
+        // see parse_options::maxDepth
+        size_t maxDepth = 1024;
+    };
+
+    struct line_error
+    {
+        // counted from one, blank lines included
+        size_t line;
+        std::string problem;
+    };
+
+    // newline delimited json : one value per non blank line, in input order.
+    // a line that does not parse is reported in the errors and the batch
+    // goes on, the vector holds null in its place
+    std::vector<json> parseLines(std::string_view, std::vector<line_error> &, const line_options & = line_options());
+
+    // hands every value that parsed to the callback with its line number,
+    // in order and from the calling thread, only a few chunks are in memory
+    void parseLines(std::string_view, const std::function<void(size_t, json &&)> &, std::vector<line_error> &, const line_options & = line_options());
+
+    std::vector<json> parseLinesFile(std::string, std::vector<line_error> &, const line_options & = line_options());
+
+    void parseLinesFile(std::string, const std::function<void(size_t, json &&)> &, std::vector<line_error> &, const line_options & = line_options());
+
+    // parses a document handed over in pieces as they arrive, such as a
+    // body read from a socket without blocking. each piece is parsed when
+    // fed, only a token cut by its end is kept until the next one, along
+    // with the containers still open
+    class push_parser
+    {
+        struct machine;
+        std::unique_ptr<machine> state;
+
+        friend json parse(std::istream &);
+
+        public:
+        // builds the document, taken with result() once complete. input is
+        // never borrowed, strings are copied out of the pieces
+        explicit push_parser(const parse_options & = parse_options());
+        // reports the events to the handler instead, of the parse_options
+        // only maxDepth is used
+        explicit push_parser(sax_handler &, const parse_options & = parse_options());
+        push_parser(push_parser &&) noexcept;
+        push_parser &operator=(push_parser &&) noexcept;
+        ~push_parser();
+
+        // true once a whole document was read, anything but whitespace
+        // after it is an error. after an error the parser needs a reset()
+        bool feed(const char *, size_t);
+        bool feed(std::string_view);
+        // the input is over : ends a number left open at the top level and
+        // throws read_error when the document is not complete
+        void finish();
+        bool done() const;
+        // takes the built document and readies the parser for the next one
+        json result();
+        void reset();
+    };
+
+    // reads the stream a block at a time through a push_parser until it
+    // ends, memory does not grow with the input
+    void parse(std::istream &, sax_handler &, const parse_options & = parse_options());
+
+    struct print_options
+    {
+        // below zero everything goes on one line, otherwise every member
+        // and element gets its own line indented by that many spaces
+        int indent = -1;
+        // no spaces after commas and colons
+        bool compact = false;
+    };
+
+    std::string print(const json&);
+
+    std::string print(const json&, const print_options &);
+
+    void print(const json&, std::ostream &, const print_options & = print_options());
+
+    void print(const json&, std::FILE *, const print_options & = print_options());
+
+    void printDescriptor(const json&, int, const print_options & = print_options());
+    
+    void printFile(const json&, const std::string&);
+
+    void printFile(const json&, const std::string&, const print_options &);
+    
+    std::ostream &operator<<(std::ostream &, const json &);
+
+    // compact binary forms of the same tree, for services that do not need
+    // text. every type maps onto one of the format's own and numbers stay
+    // integers or doubles as they are held
+    enum class binary_format : unsigned char
+    {
+        // rfc 8949
+        cbor,
+        messagePack
+    };
+
+    std::string encode(const json&, binary_format);
+
+    void encode(const json&, binary_format, std::ostream &);
+
+    // one value, anything after it throws read_error. byte strings,
+    // extension types and keys that are not strings have no json type and
+    // throw as well, cbor tags are skipped. of the parse_options the
+    // resource, borrowInput, keys and maxDepth apply
+    json decode(std::string_view, binary_format);
+
+    json decode(std::string_view, binary_format, const parse_options &);
+
+    json decode(const char *, size_t, binary_format, const parse_options & = parse_options());
+
+    void decode(std::string_view, binary_format, sax_handler &);
+
+    // reads what is left of the stream a block at a time and decodes one
+    // value, the stream is left right after it when it is seekable
+    json decode(std::istream &, binary_format);
+
+    enum class phase : unsigned char
+    {
+        parsing,
+        printing,
+        copying
+    };
+
+    // what parse, print and node copies did, either for one call or summed
+    // over a thread. the library only records it when built with
+    // BADGE881_JSON_STATS, otherwise the hooks compile to nothing and every
+    // figure stays zero
+    struct statistics
+    {
+        size_t calls = 0;
+        size_t bytesRead = 0;
+        size_t bytesWritten = 0;
+        // parsed values by type
+        size_t nodes[collectionType + 1] = {};
+        size_t maxDepth = 0;
+        // node payloads, their buffers and what was taken from a resource
+        size_t allocations = 0;
+        size_t allocatedBytes = 0;
+        // by phase
+        uint64_t nanoseconds[3] = {};
+
+        statistics &operator+=(const statistics &);
+    };
+
+    bool statisticsEnabled();
+
+    // the totals of the calling thread, a call nested in another one such
+    // as the parse run by parseFile only counts towards the outer call
+    const statistics &threadStatistics();
+
+    void resetThreadStatistics();
+
+    // called on the thread that made it after every outermost call, with
+    // the figures of that call alone. empty to remove, set it before other
+    // threads use the library. it must not throw, and what it parses or
+    // prints itself is not recorded
+    void setStatisticsObserver(std::function<void(phase, const statistics &)>);
+
+    // monotonic memory resource for request scoped documents : parse into
+    // it, use the document, then drop both at once. nothing is freed before
+    // release() or the destructor, which hand back whole blocks
+    class arena : public std::pmr::memory_resource
+    {
+        struct block;
+        block *blocks = nullptr;
+        char *current = nullptr;
+        size_t left = 0;
+        size_t nextSize;
+        size_t reserved = 0;
+        std::vector<std::shared_ptr<const void>> kept;
+
+        void *do_allocate(size_t, size_t) override;
+        void do_deallocate(void *, size_t, size_t) override;
+        bool do_is_equal(const std::pmr::memory_resource &) const noexcept override;
+
+        public:
+        arena(size_t firstBlock = 64 * 1024);
+        arena(const arena &) = delete;
+        arena &operator=(const arena &) = delete;
+        ~arena();
+
+        void release();
+        size_t capacity() const;
+        // holds on to whatever the documents in the arena point into, such as
+        // a mapped input file, until release()
+        void keepAlive(std::shared_ptr<const void>);
+    };
+    
+    // dictionary of object keys shared between documents : every key is
+    // stored once with its hash, and members of documents parsed with the
+    // table point to it, copies included. safe to use from several threads
+    class key_table
+    {
+        struct shard;
+        shard *shards;
+
+        public:
+        key_table();
+        key_table(const key_table &) = delete;
+        key_table &operator=(const key_table &) = delete;
+        ~key_table();
+
+        const key_atom *intern(std::string_view);
+        size_t size() const;
+    };
+
+    // a key read from many objects, such as a field in a hot loop : its
+    // hash is worked out once, and a handle made from a key_table matches
+    // members parsed with that table by address
+    class key_handle
+    {
+        std::string text;
+        uint32_t hashValue;
+        const key_atom *atom = nullptr;
+
+        public:
+        explicit key_handle(std::string_view);
+        key_handle(key_table &, std::string_view);
+
+        std::string_view view() const
+        {
+            return text;
+        }
+
+        uint32_t hash() const
+        {
+            return hashValue;
+        }
+
+        const key_atom *interned() const
+        {
+            return atom;
+        }
+    };
+
+    class json
+    {
+        
+        type typeName = nullType;
+
+        // numbers keep the exact integer they were built or parsed from
+        // when there is one, doubles only when they need a fraction or
+        // exponent or do not fit 64 bits
+        enum class number_kind : unsigned char
+        {
+            real,
+            integer,
+            unsignedInteger
+        };
+        number_kind numberKind = number_kind::real;
+
+        // set when the payload lives in a memory resource the node does not
+        // own : it is read in place and never freed, and turned into owned
+        // storage before anything hands out a mutable reference into it
+        bool borrowed = false;
+        // objects keep their members in insertion order, only a caller of
+        // the mutable get<unordered_map>() turns one into such a map
+        bool mapped = false;
+        uint32_t borrowedSize = 0;
+
+        // scalars live inline, strings and containers out of line so that
+        // every node stays two words wide whatever it holds. owned payloads
+        // are shared by copies and cloned on the first write through one
+        union
+        {
+            std::nullptr_t dataForNull;
+            bool dataForBoolean;
+            double dataForNum;
+            long long dataForInt;
+            unsigned long long dataForUInt;
+            counted<std::string> *dataForString;
+            counted<std::vector<json>> *dataForCollection;
+            counted<flat_object> *dataForObject;
+            counted<std::unordered_map<std::string, json>> *dataForMap;
+            const char *dataForChars;
+            json *dataForElements;
+            borrowed_member *dataForMembers;
+        };
+
+        friend class node_access;
+
+        void allocate();
+        void release() noexcept;
+        void steal(json &) noexcept;
+        void copyNumber(const json &) noexcept;
+        bool sameNumber(const json &) const;
+        bool writable() const;
+        void own();
+        
+        public:
+        json();
+        json(const json &);
+        json(json &&) noexcept;
+        json(const type &);
+        json(const std::string &);
+        json(const char*);
+        json(bool);
+        json(double);
+        json(int);
+        json(unsigned int);
+        json(long long);
+        json(unsigned long long);
+        json(collection);
+        json(object);
+        json(std::vector<json>);
+        json(std::unordered_map<std::string, json>);
+
+        // deep copies whose strings and containers come from the resource
+        json(const json &, std::pmr::memory_resource &);
+        json(std::string_view, std::pmr::memory_resource &);
+        json(const std::string &, std::pmr::memory_resource &);
+        json(const char *, std::pmr::memory_resource &);
+        json(collection, std::pmr::memory_resource &);
+        json(object, std::pmr::memory_resource &);
+        
+        json &operator=(const type &);
+        json &operator=(const json &);
+        json &operator=(json &&) noexcept;
+        json &operator=(const std::string &);
+        json &operator=(bool);
+        json &operator=(double);
+        json &operator=(int);
+        json &operator=(unsigned int);
+        json &operator=(long long);
+        json &operator=(unsigned long long);
+        json &operator=(collection);
+        json &operator=(object);
+        json &operator=(std::vector<json>);
+        json &operator=(std::unordered_map<std::string, json>);
+        
+        ~json();
+        void clear();
+        
+        class type_error : public std::exception
+        {
+            std::string problem;
+            
+            public:
+            type_error(std::string p) : problem(p) {}
+            const char *what() const noexcept override { return problem.c_str(); }
+        };
+        class read_error : public std::exception
+        {
+            std::string problem;
+            
+            public:
+            read_error(std::string p) : problem(p) {}
+            const char *what() const noexcept override { return problem.c_str(); }
+        };
+        class write_error : public std::exception
+        {
+            std::string problem;
+            
+            public:
+            write_error(std::string p) : problem(p) {}
+            const char *what() const noexcept override { return problem.c_str(); }
+        };
+
+        bool isNull() const;
+        bool isBoolean() const;
+        bool isNumber() const;
+        bool isInteger() const;
+        bool isString() const;
+        bool isObject() const;
+        bool isCollection() const;
+        
+        type getType() const;
+        std::string getTypeString() const;
+        
+        // a const node hands out copies, the value may be stored in another
+        // form than the one asked for
+        template <typename typeT>
+        typeT &get();
+        template <typename typeT>
+        typeT get() const;
+
+        // the decoded text of the string, without copying it. valid until
+        // the value is changed or destroyed
+        std::string_view getStringView() const;
+        
+        // adds a null member when the key is missing
+        json &operator[](std::string_view);
+        json &operator[](const int &);
+
+        // lookups that never add anything : find gives null and at throws
+        // std::out_of_range when the member is missing
+        const json *find(std::string_view) const;
+        json *find(std::string_view);
+        const json *find(const key_handle &) const;
+        json *find(const key_handle &);
+        const json &at(std::string_view) const;
+        json &at(std::string_view);
+        const json &at(const key_handle &) const;
+        json &at(const key_handle &);
+        bool contains(std::string_view) const;
+        bool contains(const key_handle &) const;
+        
+        bool operator==(const json &) const;
+        bool operator!=(const json &) const;
+    };
+
+    // cursor over the raw text of a document that parses nothing up front :
+    // operator[] skips the members and elements it walks past by bracket
+    // matching and values are only read when asked for. skipped text is not
+    // validated and the text has to outlive every cursor taken from it
+    class lazy_json
+    {
+        const char *current = nullptr;
+        const char *end = nullptr;
+
+        lazy_json(const char *, const char *);
+
+        public:
+        lazy_json(std::string_view);
+        lazy_json(const char *, size_t);
+
+        type getType() const;
+        std::string getTypeString() const;
+
+        // the value itself, containers are parsed completely
+        json value() const;
+
+        template <typename typeT>
+        typeT get() const
+        {
+            return static_cast<const json &>(value()).get<typeT>();
+        }
+
+        // the text between the quotes, escapes as written. get<std::string>
+        // decodes them
+        std::string_view getStringView() const;
+        // the value as written in the input
+        std::string_view getText() const;
+
+        // the first member with that key, where parse keeps the last one
+        lazy_json operator[](std::string_view) const;
+        lazy_json operator[](int) const;
+        bool contains(std::string_view) const;
+        // members of an object or elements of a collection
+        size_t size() const;
+    };
+
+    template <>
+    inline std::string_view lazy_json::get<std::string_view>() const
+    {
+        return getStringView();
+    }
+
+    struct schema_error
+    {
+        // json pointer to the value that failed, empty for the document
+        std::string path;
+        std::string problem;
+    };
+
+    // a json schema compiled once, subschemas resolved to nodes with their
+    // regexes built and $ref followed, then run against many documents.
+    // covers the validation keywords of draft 7 with references inside the
+    // schema, by json pointer or to a plain name $id such as #node. format
+    // and remote references are not checked
+    class schema
+    {
+        struct program;
+        std::shared_ptr<const program> compiled;
+
+        public:
+        // throws type_error when the schema does not compile
+        explicit schema(const json &);
+
+        // the check recurses once per level of the document, values nested
+        // deeper than parse_options::maxDepth by default fail validation
+        bool validate(const json &) const;
+        bool validate(const json &, schema_error &) const;
+        // checks the text while reading it and stops at the first problem
+        // without building the document, only values under keywords that
+        // need them whole, such as anyOf, enum or uniqueItems, are built.
+        // malformed text throws read_error
+        bool validateText(std::string_view) const;
+        bool validateText(std::string_view, schema_error &) const;
+    };
+
+    // a json pointer such as /items/0/name, or a json path such as
+    // $.items[*].name, compiled once and run against many documents. json
+    // paths take member names, [*], recursive descent .., positions and
+    // unions [0,-1], slices [start:end:step] and filters comparing a member
+    // of the element to a value, [?(@.price < 10 && @.tag == 'a')]. throws
+    // read_error on a query it cannot read
+    class query
+    {
+        struct program;
+        std::shared_ptr<const program> compiled;
+
+        public:
+        explicit query(std::string_view);
+
+        // the matching values in document order, pointing into the document
+        std::vector<const json *> select(const json &) const;
+        // stops at the first match, null when there is none
+        const json *first(const json &) const;
+        // runs over the text without building the document : values no step
+        // can reach into are skipped after a check and only the matches are
+        // built, or a whole collection when a filter or a position counted
+        // from the end needs it. of the parse_options only maxDepth is used
+        std::vector<json> selectText(std::string_view, const parse_options & = parse_options()) const;
+    };
+
+    // pull reader over the text of a document, what parse<T> reads structs
+    // through : every call consumes one token or value and checks the
+    // grammar on the way, nothing is built that was not asked for. strings
+    // are views into the text, or into the reader when they had escapes to
+    // decode, valid until the next string is read
+    class token_reader
+    {
+        const char *current;
+        const char *end;
+        // right after an opening bracket, where no comma comes first
+        bool opened = false;
+        std::string decoded;
+        // containers opened and not closed yet, values read whole count
+        // from there against the same limit
+        size_t depth = 0;
+        size_t maxDepth;
+
+        void expect(type, const char *);
+        bool advance(char, const char *);
+
+        public:
+        // nesting deeper than maxDepth throws read_error, as in parse. of
+        // the parse_options only maxDepth is used
+        token_reader(std::string_view, const parse_options & = parse_options());
+        token_reader(const char *, size_t, const parse_options & = parse_options());
+
+        type peekType();
+        void readNull();
+        bool readBool();
+        // read the way parse reads numbers, integers stay exact
+        json readNumber();
+        // the number as that type, type_error when it does not convert exactly
+        long long readInteger();
+        unsigned long long readUnsigned();
+        double readDouble();
+        std::string_view readString();
+        json readValue();
+        void skipValue();
+        void beginObject();
+        // moves past the next key and its colon, false once the object closed
+        bool nextKey(std::string_view &);
+        void beginCollection();
+        // false once the collection closed
+        bool nextElement();
+        // throws read_error unless only whitespace is left
+        void finish();
+    };
+
+    // the writing side of print<T>, appends to the string laid out the way
+    // print lays out a document
+    class token_writer
+    {
+        std::string &buffer;
+        print_options options;
+        int depth = 0;
+        bool afterValue = false;
+        bool afterKey = false;
+
+        void prefix();
+
+        public:
+        token_writer(std::string &, const print_options & = print_options());
+
+        void writeNull();
+        void writeBool(bool);
+        void writeInteger(long long);
+        void writeUnsigned(unsigned long long);
+        void writeNumber(double);
+        void writeString(std::string_view);
+        void writeValue(const json &);
+        void beginObject();
+        void key(std::string_view);
+        void endObject();
+        void beginCollection();
+        void endCollection();
+    };
+
+    // one member of a struct bound to json, see BADGE881_JSON_FIELDS
+    template <typename ownerT, typename memberT>
+    struct field
+    {
+        std::string_view name;
+        memberT ownerT::*member;
+    };
+
+    template <typename ownerT, typename memberT>
+    constexpr field<ownerT, memberT> bindField(std::string_view name, memberT ownerT::*member)
+    {
+        return {name, member};
+    }
+
+    namespace binding
+    {
+        // a struct is bound by a badge881JsonFields(const T *) found next to
+        // it, returning a tuple of its fields
+        template <typename T, typename = void>
+        struct has_fields : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct has_fields<T, std::void_t<decltype(badge881JsonFields(static_cast<const T *>(nullptr)))>> : std::true_type
+        {
+        };
+
+        template <typename T>
+        struct is_vector : std::false_type
+        {
+        };
+
+        template <typename T, typename allocatorT>
+        struct is_vector<std::vector<T, allocatorT>> : std::true_type
+        {
+        };
+
+        template <typename T>
+        struct is_optional : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_optional<std::optional<T>> : std::true_type
+        {
+        };
+
+        template <typename T>
+        struct is_map : std::false_type
+        {
+        };
+
+        template <typename T, typename compareT, typename allocatorT>
+        struct is_map<std::map<std::string, T, compareT, allocatorT>> : std::true_type
+        {
+        };
+
+        // what parse<T> and print take at the top, their elements may also
+        // be numbers, booleans, strings and json
+        template <typename T>
+        struct bindable : std::bool_constant<has_fields<T>::value || is_vector<T>::value || is_optional<T>::value || is_map<T>::value>
+        {
+        };
+
+        template <typename>
+        inline constexpr bool unbound = false;
+
+        template <bool exact, typename T>
+        void read(token_reader &, T &);
+
+        template <typename T>
+        constexpr auto fieldsOf()
+        {
+            return badge881JsonFields(static_cast<const T *>(nullptr));
+        }
+
+        constexpr uint32_t keyHash(std::string_view key, uint32_t seed)
+        {
+            for (char c : key)
+                seed = (seed ^ static_cast<unsigned char>(c)) * 16777619u;
+            return seed ^ (seed >> 15);
+        }
+
+        // perfect hash of the member names of a bound struct, searched for at
+        // compile time : a seed and a power of two table in which every name
+        // has a slot of its own, so a key is found with one hash and one
+        // comparison
+        template <typename T>
+        struct key_index
+        {
+            static constexpr size_t count = std::tuple_size_v<decltype(fieldsOf<T>())>;
+            static constexpr unsigned char none = 255;
+
+            static constexpr std::array<std::string_view, count> names = std::apply([](const auto &...fields)
+                                                                                    { return std::array<std::string_view, count>{fields.name...}; },
+                                                                                    fieldsOf<T>());
+
+            struct table
+            {
+                bool found = false;
+                uint32_t seed = 0;
+                uint32_t mask = 0;
+                std::array<unsigned char, 256> slots{};
+            };
+
+            static constexpr table search()
+            {
+                size_t size = 1;
+                while (size < count)
+                    size *= 2;
+                for (; size <= 256; size *= 2)
+                    for (uint32_t attempt = 0, seed = 2166136261u; attempt < 64; ++attempt, seed += 0x9e3779b9u)
+                    {
+                        table t;
+                        t.seed = seed;
+                        t.mask = uint32_t(size - 1);
+                        for (unsigned char &slot : t.slots)
+                            slot = none;
+                        bool clash = false;
+                        for (size_t i = 0; i < count && !clash; ++i)
+                        {
+                            unsigned char &slot = t.slots[keyHash(names[i], seed) & t.mask];
+                            clash = slot != none;
+                            slot = static_cast<unsigned char>(i);
+                        }
+                        if (!clash)
+                        {
+                            t.found = true;
+                            return t;
+                        }
+                    }
+                return table();
+            }
+
+            static constexpr table slots = search();
+            static_assert(count < none, "too many fields in one struct");
+            static_assert(slots.found, "two fields of the struct have the same name");
+
+            // position of the field named key, none when there is no such field
+            static size_t find(std::string_view key)
+            {
+                size_t i = slots.slots[keyHash(key, slots.seed) & slots.mask];
+                return i != none && names[i] == key ? i : none;
+            }
+
+            template <bool exact, size_t i>
+            static void readField(token_reader &reader, T &value)
+            {
+                read<exact>(reader, value.*std::get<i>(fieldsOf<T>()).member);
+            }
+
+            template <bool exact, size_t... i>
+            static constexpr std::array<void (*)(token_reader &, T &), count> readers(std::index_sequence<i...>)
+            {
+                return {&readField<exact, i>...};
+            }
+        };
+
+        // with exact set the text has to hold the shape of T and nothing
+        // else, an unknown member throws instead of being skipped
+        template <bool exact, typename T>
+        void read(token_reader &reader, T &value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+                value = reader.readBool();
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+            {
+                long long number = reader.readInteger();
+                if (number < (std::numeric_limits<T>::min)() || number > (std::numeric_limits<T>::max)())
+                    throw json::type_error("json number does not fit the field");
+                value = static_cast<T>(number);
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                unsigned long long number = reader.readUnsigned();
+                if (number > (std::numeric_limits<T>::max)())
+                    throw json::type_error("json number does not fit the field");
+                value = static_cast<T>(number);
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+                value = static_cast<T>(reader.readDouble());
+            else if constexpr (std::is_same_v<T, std::string>)
+                value = reader.readString();
+            else if constexpr (std::is_same_v<T, json>)
+                value = reader.readValue();
+            else if constexpr (is_optional<T>::value)
+            {
+                if (reader.peekType() == nullType)
+                {
+                    reader.readNull();
+                    value.reset();
+                    return;
+                }
+                if (!value)
+                    value.emplace();
+                read<exact>(reader, *value);
+            }
+            else if constexpr (is_vector<T>::value)
+            {
+                value.clear();
+                reader.beginCollection();
+                while (reader.nextElement())
+                    if constexpr (std::is_same_v<typename T::value_type, bool>)
+                        value.push_back(reader.readBool());
+                    else
+                        read<exact>(reader, value.emplace_back());
+            }
+            else if constexpr (is_map<T>::value)
+            {
+                // a repeated key takes the last value, as with parse
+                value.clear();
+                reader.beginObject();
+                std::string_view key;
+                while (reader.nextKey(key))
+                    read<exact>(reader, value[std::string(key)]);
+            }
+            else if constexpr (has_fields<T>::value)
+            {
+                using index = key_index<T>;
+                static constexpr auto readers = index::template readers<exact>(std::make_index_sequence<index::count>());
+                reader.beginObject();
+                std::string_view key;
+                while (reader.nextKey(key))
+                {
+                    size_t i = index::find(key);
+                    if (i != index::none)
+                        readers[i](reader, value);
+                    else if constexpr (exact)
+                        throw json::type_error("unexpected member : " + std::string(key));
+                    else
+                        reader.skipValue();
+                }
+            }
+            else
+                static_assert(unbound<T>, "no json binding for this type, list its fields with BADGE881_JSON_FIELDS");
+        }
+
+        template <typename T>
+        void write(token_writer &writer, const T &value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+                writer.writeBool(value);
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+                writer.writeInteger(value);
+            else if constexpr (std::is_integral_v<T>)
+                writer.writeUnsigned(value);
+            else if constexpr (std::is_floating_point_v<T>)
+                writer.writeNumber(static_cast<double>(value));
+            else if constexpr (std::is_same_v<T, std::string>)
+                writer.writeString(value);
+            else if constexpr (std::is_same_v<T, json>)
+                writer.writeValue(value);
+            else if constexpr (is_optional<T>::value)
+            {
+                if (value)
+                    write(writer, *value);
+                else
+                    writer.writeNull();
+            }
+            else if constexpr (is_vector<T>::value)
+            {
+                writer.beginCollection();
+                for (const auto &element : value)
+                    write(writer, static_cast<const typename T::value_type &>(element));
+                writer.endCollection();
+            }
+            else if constexpr (is_map<T>::value)
+            {
+                writer.beginObject();
+                for (const auto &[key, element] : value)
+                {
+                    writer.key(key);
+                    write(writer, element);
+                }
+                writer.endObject();
+            }
+            else if constexpr (has_fields<T>::value)
+            {
+                writer.beginObject();
+                std::apply([&](const auto &...fields)
+                           { ((writer.key(fields.name), write(writer, value.*fields.member)), ...); },
+                           badge881JsonFields(static_cast<const T *>(nullptr)));
+                writer.endObject();
+            }
+            else
+                static_assert(unbound<T>, "no json binding for this type, list its fields with BADGE881_JSON_FIELDS");
+        }
+    }
+
+    // fills a struct listed with BADGE881_JSON_FIELDS, or a vector, optional
+    // or map of such, straight from the text without building a document.
+    // members the struct does not list are skipped and fields missing from
+    // the text keep the value they had
+    template <typename T, typename = std::enable_if_t<binding::bindable<T>::value>>
+    void parse(std::string_view text, T &value)
+    {
+        token_reader reader(text);
+        binding::read<false>(reader, value);
+        reader.finish();
+    }
+
+    template <typename T, typename = std::enable_if_t<binding::bindable<T>::value>>
+    T parse(std::string_view text)
+    {
+        T value{};
+        parse(text, value);
+        return value;
+    }
+
+    // the fast path for message types of a fixed shape : the text is read
+    // as exactly a T, keys found by the perfect hash of key_index. when it
+    // holds anything else, such as an unknown member, another type or bad
+    // json, the generic parse reads it into other instead and value is left
+    // partly filled. returns whether value was filled
+    template <typename T, typename = std::enable_if_t<binding::bindable<T>::value>>
+    bool parseExact(std::string_view text, T &value, json &other)
+    {
+        try
+        {
+            token_reader reader(text);
+            binding::read<true>(reader, value);
+            reader.finish();
+            return true;
+        }
+        catch (const json::type_error &)
+        {
+        }
+        catch (const json::read_error &)
+        {
+        }
+        other = parse(text);
+        return false;
+    }
+
+    // the same text print gives for the equivalent document, members in the
+    // order the fields are listed
+    template <typename T, typename = std::enable_if_t<binding::bindable<T>::value>>
+    std::string print(const T &value, const print_options &options = print_options())
+    {
+        std::string out;
+        token_writer writer(out, options);
+        binding::write(writer, value);
+        return out;
+    }
+    json parse(std::string_view);
+    json parse(std::istream &);
+};
+
+template <>
+struct std::hash<badge881::json::json>
+{
+    size_t operator()(const badge881::json::json &) const noexcept;
+
+private:
+    void combine(size_t &, const size_t &) const noexcept;
+};
+
+// binds a struct to json for parse<T> and print, used at namespace scope
+// next to the struct with the members to read and write, which keep their
+// names in the text : BADGE881_JSON_FIELDS(point, x, y). up to 24 members
+#define BADGE881_JSON_FIELDS(typeT, ...)                                         \
+    constexpr auto badge881JsonFields(const typeT *)                            \
+    {                                                                           \
+        return std::make_tuple(BADGE881_JSON_FOR_EACH(typeT, __VA_ARGS__));     \
+    }
+
+// the expansions are spelled out one count at a time for preprocessors
+// without __VA_OPT__
+#define BADGE881_JSON_EXPAND(x) x
+#define BADGE881_JSON_FIELDS_1(typeT, name) ::badge881::json::bindField(#name, &typeT::name)
+#define BADGE881_JSON_FIELDS_2(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_1(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_3(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_2(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_4(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_3(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_5(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_4(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_6(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_5(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_7(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_6(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_8(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_7(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_9(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_8(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_10(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_9(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_11(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_10(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_12(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_11(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_13(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_12(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_14(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_13(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_15(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_14(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_16(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_15(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_17(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_16(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_18(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_17(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_19(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_18(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_20(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_19(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_21(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_20(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_22(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_21(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_23(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_22(typeT, __VA_ARGS__))
+#define BADGE881_JSON_FIELDS_24(typeT, name, ...) BADGE881_JSON_FIELDS_1(typeT, name), BADGE881_JSON_EXPAND(BADGE881_JSON_FIELDS_23(typeT, __VA_ARGS__))
+#define BADGE881_JSON_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, chosen, ...) chosen
+#define BADGE881_JSON_FOR_EACH(typeT, ...) BADGE881_JSON_EXPAND(BADGE881_JSON_PICK(__VA_ARGS__, BADGE881_JSON_FIELDS_24, BADGE881_JSON_FIELDS_23, BADGE881_JSON_FIELDS_22, BADGE881_JSON_FIELDS_21, BADGE881_JSON_FIELDS_20, BADGE881_JSON_FIELDS_19, BADGE881_JSON_FIELDS_18, BADGE881_JSON_FIELDS_17, BADGE881_JSON_FIELDS_16, BADGE881_JSON_FIELDS_15, BADGE881_JSON_FIELDS_14, BADGE881_JSON_FIELDS_13, BADGE881_JSON_FIELDS_12, BADGE881_JSON_FIELDS_11, BADGE881_JSON_FIELDS_10, BADGE881_JSON_FIELDS_9, BADGE881_JSON_FIELDS_8, BADGE881_JSON_FIELDS_7, BADGE881_JSON_FIELDS_6, BADGE881_JSON_FIELDS_5, BADGE881_JSON_FIELDS_4, BADGE881_JSON_FIELDS_3, BADGE881_JSON_FIELDS_2, BADGE881_JSON_FIELDS_1)(typeT, __VA_ARGS__))
@@ -0,0 +1,121 @@
+#include "../include/json.h"
+#include "check.h"
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace badge881::json;
+
+namespace shop
+{
+    struct item
+    {
+        std::string name;
+        unsigned count = 0;
+        double price = 0;
+    };
+    BADGE881_JSON_FIELDS(item, name, count, price)
+
+    struct order
+    {
+        long long id = 0;
+        bool paid = false;
+        std::vector<item> items;
+        std::optional<std::string> note;
+        std::map<std::string, int> totals;
+        std::vector<bool> flags;
+        json extra;
+        short small = 0;
+    };
+    BADGE881_JSON_FIELDS(order, id, paid, items, note, totals, flags, extra, small)
+}
+
+namespace
+{
+    using shop::item;
+    using shop::order;
+
+    bool same(const order &a, const order &b)
+    {
+        if (a.items.size() != b.items.size())
+            return false;
+        for (size_t i = 0; i < a.items.size(); ++i)
+            if (a.items[i].name != b.items[i].name || a.items[i].count != b.items[i].count || a.items[i].price != b.items[i].price)
+                return false;
+        return a.id == b.id && a.paid == b.paid && a.note == b.note && a.totals == b.totals && a.flags == b.flags && a.extra == b.extra && a.small == b.small;
+    }
+
+    template <typename T>
+    bool throws(const std::string &text)
+    {
+        try
+        {
+            parse<T>(text);
+        }
+        catch (const json::type_error &)
+        {
+            return true;
+        }
+        catch (const json::read_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    order o;
+    o.id = -9223372036854775807LL - 1;
+    o.paid = true;
+    o.items = {{"pen", 3, 1.25}, {"caf\xc3\xa9 \"noir\"", 1, 4}, {"", 0, 0}};
+    o.note = "leave at the door\n";
+    o.totals = {{"eur", 12}, {"usd", -3}};
+    o.flags = {true, false, true};
+    o.extra = parse("{\"a\": [1, 2.5, null], \"b\": {}}");
+    o.small = -32768;
+
+    // print of the struct is what print gives for the same document
+    std::string text = print(o);
+    check(text == print(parse(text)), "struct printed like the document");
+    check(same(parse<order>(text), o), "round trip");
+    print_options indented;
+    indented.indent = 2;
+    check(same(parse<order>(print(o, indented)), o), "round trip through indented text");
+    check(print(parse<order>(text), indented) == print(parse(text), indented), "indented print matches the document");
+
+    // null resets an optional, missing fields keep their value
+    order kept = o;
+    parse("{\"note\": null, \"id\": 5}", kept);
+    check(!kept.note && kept.id == 5 && kept.items.size() == 3, "null optional and missing fields");
+
+    // members the struct does not list are skipped, whatever they hold
+    order skipped = parse<order>("{\"unknown\": {\"deep\": [1, {\"x\": \"}\"}]}, \"id\": 7, \"other\": \"]\"}");
+    check(skipped.id == 7, "unknown members skipped");
+
+    // a repeated key takes the last value, as parse does
+    std::string repeated = "{\"id\": 1, \"note\": \"a\", \"id\": 2, \"note\": null, \"totals\": {\"x\": 1, \"x\": 2}}";
+    order last = parse<order>(repeated);
+    json document = parse(repeated);
+    check(last.id == 2 && document["id"] == json(2), "repeated field");
+    check(!last.note && document["note"].isNull(), "repeated field set to null");
+    check(last.totals.size() == 1 && last.totals["x"] == 2 && document["totals"]["x"] == json(2), "repeated map key");
+
+    // vectors, optionals and maps at the top
+    check(parse<std::vector<item>>("[{\"name\": \"a\"}, {\"count\": 2}]").size() == 2, "vector at the top");
+    check(!parse<std::optional<item>>("null"), "optional at the top");
+    check(parse<std::map<std::string, item>>("{\"k\": {\"price\": 2}}")["k"].price == 2, "map at the top");
+
+    // values that do not fit the field throw
+    check(throws<order>("{\"small\": 32768}"), "integer past the field");
+    check(throws<item>("{\"count\": -1}"), "negative into unsigned");
+    check(throws<item>("{\"count\": 1.5}"), "fraction into an integer");
+    check(throws<item>("{\"name\": 1}"), "number into a string");
+    check(throws<order>("{\"items\": {}}"), "object into a vector");
+    check(throws<order>("{\"id\": 1} x"), "trailing text");
+    check(throws<order>("{\"id\": 1"), "text cut short");
+    check(!throws<item>("{\"count\": 2.0}"), "integral double into an integer");
+    return report();
+}
@@ -0,0 +1,120 @@
+#include "../include/json.h"
+#include "check.h"
+#include <cmath>
+#include <string>
+
+using namespace badge881::json;
+
+namespace
+{
+    std::string bytes(const char *hex)
+    {
+        std::string out;
+        for (; hex[0] && hex[1]; hex += 2)
+            out += char(std::stoi(std::string(hex, 2), nullptr, 16));
+        return out;
+    }
+
+    // the text parsed, encoded and decoded again equals the parsed value
+    // and keeps integers apart from doubles
+    void roundTrip(const char *text, size_t size, const char *what)
+    {
+        json value = parse(text);
+        std::string encoded = encode(value, binary_format::cbor);
+        json decoded = decode(encoded, binary_format::cbor);
+        check(encoded.size() == size, what);
+        check(decoded == value && decoded.isInteger() == value.isInteger() && print(decoded) == print(value), what);
+    }
+
+    bool throws(const std::string &input, const parse_options &options = parse_options())
+    {
+        try
+        {
+            decode(input, binary_format::cbor, options);
+        }
+        catch (const json::read_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    // the head grows at 24, 2^8, 2^16 and 2^32, negatives count from -1
+    roundTrip("0", 1, "zero");
+    roundTrip("23", 1, "largest immediate");
+    roundTrip("24", 2, "smallest one byte argument");
+    roundTrip("255", 2, "largest one byte argument");
+    roundTrip("256", 3, "smallest two byte argument");
+    roundTrip("65535", 3, "largest two byte argument");
+    roundTrip("65536", 5, "smallest four byte argument");
+    roundTrip("4294967295", 5, "largest four byte argument");
+    roundTrip("4294967296", 9, "smallest eight byte argument");
+    roundTrip("18446744073709551615", 9, "2^64 - 1");
+    roundTrip("-1", 1, "minus one");
+    roundTrip("-24", 1, "smallest immediate");
+    roundTrip("-25", 2, "largest one byte negative");
+    roundTrip("-256", 2, "smallest one byte negative");
+    roundTrip("-257", 3, "largest two byte negative");
+    roundTrip("-4294967296", 5, "smallest four byte negative");
+    roundTrip("-4294967297", 9, "largest eight byte negative");
+    roundTrip("-9223372036854775808", 9, "-2^63");
+    // doubles a float holds exactly take five bytes, the others nine
+    roundTrip("1.5", 5, "double held by a float");
+    roundTrip("1.0", 5, "integral double stays a double");
+    roundTrip("-0.0", 5, "negative zero");
+    roundTrip("1.1", 9, "double that needs 64 bits");
+    roundTrip("1e300", 9, "double past the float range");
+    roundTrip("\"\"", 1, "empty string");
+    roundTrip("\"\\u00fc\\n\"", 4, "string with escapes");
+    roundTrip("{\"a\": [1, {\"b\": [], \"c\": {}}, \"\"], \"d\": null, \"e\": [true, false]}", 21, "nested containers");
+    check(encode(parse("[1, [2, 3]]"), binary_format::cbor) == bytes("8201820203"), "collection head");
+    check(encode(parse("{\"a\": 1, \"b\": [2, 3]}"), binary_format::cbor) == bytes("a26161016162820203"), "object head");
+
+    // rfc 8949 appendix a : half floats, indefinite lengths and tags
+    check(decode(bytes("f93c00"), binary_format::cbor).get<double>() == 1.0, "half float one");
+    check(decode(bytes("f97bff"), binary_format::cbor).get<double>() == 65504.0, "largest half float");
+    check(decode(bytes("f90001"), binary_format::cbor).get<double>() == 5.960464477539063e-8, "half float denormal");
+    check(std::signbit(decode(bytes("f98000"), binary_format::cbor).get<double>()), "half float negative zero");
+    check(decode(bytes("f97c00"), binary_format::cbor).get<double>() == HUGE_VAL, "half float infinity");
+    check(decode(bytes("fa47c35000"), binary_format::cbor).get<double>() == 100000.0, "single float");
+    check(decode(bytes("3bffffffffffffffff"), binary_format::cbor).get<double>() == -18446744073709551616.0, "-2^64 as a double");
+    check(decode(bytes("7f657374726561646d696e67ff"), binary_format::cbor) == json("streaming"), "indefinite string");
+    check(print(decode(bytes("9f018202039f0405ffff"), binary_format::cbor)) == "[1, [2, 3], [4, 5]]", "indefinite collection");
+    check(print(decode(bytes("bf61610161629f0203ffff"), binary_format::cbor)) == "{\"a\": 1, \"b\": [2, 3]}", "indefinite object");
+    check(print(decode(bytes("bf7f61616162ff01ff"), binary_format::cbor)) == "{\"ab\": 1}", "indefinite key");
+    check(decode(bytes("c11a514b67b0"), binary_format::cbor) == json(1363896240), "tag skipped");
+    check(decode(bytes("f7"), binary_format::cbor).isNull(), "undefined read as null");
+
+    // what json has no type for, and malformed items
+    check(throws(bytes("40")), "byte string");
+    check(throws(bytes("5f4101ff")), "indefinite byte string");
+    check(throws(bytes("a10102")), "integer key");
+    check(throws(bytes("a1f6f6")), "null key");
+    check(throws(bytes("f0")), "unassigned simple value");
+    check(throws(bytes("1c")), "reserved argument");
+    check(throws(bytes("ff")), "break outside an indefinite item");
+    check(throws(bytes("7f01ff")), "indefinite string holding an integer");
+    check(throws(bytes("62c328")), "invalid utf-8");
+    check(throws(bytes("0000")), "anything after the value");
+
+    // truncated input : every prefix of a document throws
+    std::string whole = encode(parse("{\"a\": [1, 2.5, \"xyz\", {\"b\": null}], \"long\": \"0123456789012345678901234\", \"n\": -100000, \"u\": 4000000000}"), binary_format::cbor);
+    bool everyPrefix = true;
+    for (size_t size = 0; size < whole.size(); ++size)
+        everyPrefix = everyPrefix && throws(whole.substr(0, size));
+    check(everyPrefix, "truncated input");
+
+    // the depth limit of parse_options, definite and indefinite
+    std::string deep = std::string(1024, '\x81') + '\x00';
+    check(!throws(deep), "nesting at the limit");
+    check(throws('\x81' + deep), "nesting past the limit");
+    check(throws(std::string(1025, '\x9f')), "indefinite nesting past the limit");
+    parse_options raised;
+    raised.maxDepth = 100000;
+    std::string deeper = std::string(50000, '\x81') + '\x00';
+    check(!throws(deeper, raised) && encode(decode(deeper, binary_format::cbor, raised), binary_format::cbor) == deeper, "raised limit");
+    return report();
+}
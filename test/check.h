@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdio>
+
+// what every test program shares : failed checks are printed and counted,
+// main returns report() so make test stops on the first failing program
+namespace
+{
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        if (!passed)
+        {
+            std::printf("failed : %s\n", what);
+            ++failures;
+        }
+    }
+
+    int report()
+    {
+        if (failures)
+            return 1;
+        std::printf("all passed\n");
+        return 0;
+    }
+}
@@ -0,0 +1,105 @@
+#include "../include/json.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+using namespace badge881::json;
+
+namespace wire
+{
+    // glbvs and yacxa have the same 32 bit hash under the first seed the
+    // search tries, so it has to move on to another one
+    struct tick
+    {
+        std::string glbvs;
+        long long yacxa = 0;
+        double price = 0;
+        std::vector<int> sizes;
+    };
+    BADGE881_JSON_FIELDS(tick, glbvs, yacxa, price, sizes)
+
+    struct wide
+    {
+        int a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0, i = 0, j = 0, k = 0, l = 0;
+        int m = 0, n = 0, o = 0, p = 0, q = 0, r = 0, s = 0, t = 0, u = 0, v = 0, w = 0, x = 0;
+    };
+    BADGE881_JSON_FIELDS(wide, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q, r, s, t, u, v, w, x)
+}
+
+namespace
+{
+    using wire::tick;
+    using wire::wide;
+
+    template <typename T>
+    bool everyNameFound()
+    {
+        using index = binding::key_index<T>;
+        for (size_t i = 0; i < index::count; ++i)
+            if (index::find(index::names[i]) != i)
+                return false;
+        return true;
+    }
+
+    // a key that is no field but lands in the slot of the first one
+    template <typename T>
+    std::string impostor()
+    {
+        using index = binding::key_index<T>;
+        uint32_t target = binding::keyHash(index::names[0], index::slots.seed) & index::slots.mask;
+        for (int n = 0;; ++n)
+        {
+            std::string key = "key" + std::to_string(n);
+            if ((binding::keyHash(key, index::slots.seed) & index::slots.mask) == target)
+                return key;
+        }
+    }
+}
+
+int main()
+{
+    // the perfect hash : every name in a slot of its own
+    static_assert(binding::keyHash("glbvs", 2166136261u) == binding::keyHash("yacxa", 2166136261u));
+    check(binding::key_index<tick>::slots.seed != 2166136261u, "colliding names move the search to another seed");
+    check(everyNameFound<tick>(), "colliding names each found");
+    check(everyNameFound<wide>(), "24 names each found");
+    check(binding::key_index<tick>::find("glbv") == binding::key_index<tick>::none, "prefix of a name");
+    check(binding::key_index<tick>::find("") == binding::key_index<tick>::none, "empty key");
+    std::string other = impostor<tick>();
+    check(binding::key_index<tick>::find(other) == binding::key_index<tick>::none, "key in the slot of a field is compared");
+
+    // text of exactly the shape of the struct
+    std::string text = "{\"glbvs\": \"eur\", \"yacxa\": -4, \"price\": 1.5, \"sizes\": [1, 2, 3]}";
+    tick t;
+    json rest;
+    check(parseExact(text, t, rest), "exact text accepted");
+    check(t.glbvs == "eur" && t.yacxa == -4 && t.price == 1.5 && t.sizes.size() == 3, "exact text read");
+    check(print(t) == print(parse(text)), "printed back the same");
+    tick reordered;
+    check(parseExact("{\"sizes\": [], \"price\": 2, \"yacxa\": 9, \"glbvs\": \"\"}", reordered, rest) && reordered.yacxa == 9, "members in another order");
+    tick repeated;
+    check(parseExact("{\"yacxa\": 1, \"yacxa\": 2}", repeated, rest) && repeated.yacxa == 2, "repeated key takes the last value");
+    wide all;
+    check(parseExact("{\"x\": 24, \"a\": 1, \"m\": 13}", all, rest) && all.x == 24 && all.a == 1 && all.m == 13, "wide struct");
+
+    // anything else falls back to parse into the document
+    std::string unknown = "{\"glbvs\": \"eur\", \"" + other + "\": 1}";
+    tick u;
+    check(!parseExact(unknown, u, rest), "key in the slot of a field rejected");
+    check(rest == parse(unknown), "document read instead");
+    check(parse<tick>(unknown).glbvs == "eur", "the same key skipped by parse<T>");
+    check(!parseExact("{\"glbvs\": \"eur\", \"volume\": 1}", u, rest) && rest["volume"] == json(1), "unknown key rejected");
+    check(!parseExact("{\"yacxa\": \"1\"}", u, rest) && rest["yacxa"] == json("1"), "wrong type rejected");
+    check(!parseExact("[1, 2]", u, rest) && print(rest) == "[1, 2]", "another shape rejected");
+    bool malformed = false;
+    try
+    {
+        parseExact("{\"glbvs\": ", u, rest);
+    }
+    catch (const json::read_error &)
+    {
+        malformed = true;
+    }
+    check(malformed, "malformed text still throws");
+    return report();
+}
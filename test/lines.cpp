@@ -0,0 +1,100 @@
+#include "../include/json.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+using namespace badge881::json;
+
+namespace
+{
+    // every line holds its own number, every 97th is broken, every 50th
+    // blank and every 7th ends with \r\n. the last line has no newline
+    struct batch
+    {
+        std::string text;
+        std::vector<size_t> valueLines;
+        std::vector<size_t> brokenLines;
+    };
+
+    batch make(size_t count)
+    {
+        batch b;
+        for (size_t line = 1; line <= count; ++line)
+        {
+            if (line % 50 == 0)
+                b.text += "  ";
+            else if (line % 97 == 0)
+            {
+                b.text += "{\"line\": " + std::to_string(line) + ",";
+                b.valueLines.push_back(line);
+                b.brokenLines.push_back(line);
+            }
+            else
+            {
+                b.text += "{\"line\": " + std::to_string(line) + ", \"tags\": [\"a\", {\"b\": null}]}";
+                b.valueLines.push_back(line);
+            }
+            if (line != count)
+                b.text += line % 7 == 0 ? "\r\n" : "\n";
+        }
+        return b;
+    }
+}
+
+int main()
+{
+    batch b = make(5000);
+    for (unsigned threads : {1u, 4u, 0u})
+        for (size_t chunkSize : {size_t(64), size_t(4096), size_t(1) << 20})
+        {
+            line_options options;
+            options.threads = threads;
+            options.chunkSize = chunkSize;
+
+            // a value per non blank line in input order, null where it broke
+            std::vector<line_error> errors;
+            std::vector<json> values = parseLines(b.text, errors, options);
+            bool inOrder = values.size() == b.valueLines.size();
+            for (size_t i = 0; inOrder && i < values.size(); ++i)
+            {
+                size_t line = b.valueLines[i];
+                inOrder = line % 97 == 0 ? values[i].isNull() : values[i]["line"].get<long long>() == static_cast<long long>(line);
+            }
+            check(inOrder, "values in input order");
+            bool errorsInOrder = errors.size() == b.brokenLines.size();
+            for (size_t i = 0; errorsInOrder && i < errors.size(); ++i)
+                errorsInOrder = errors[i].line == b.brokenLines[i] && !errors[i].problem.empty();
+            check(errorsInOrder, "an error per broken line with its number");
+
+            // the callback sees the lines that parsed, in order
+            std::vector<line_error> callbackErrors;
+            std::vector<size_t> seen;
+            bool matching = true;
+            parseLines(b.text, [&](size_t line, json &&value)
+                       { seen.push_back(line);
+                         matching = matching && value["line"].get<long long>() == static_cast<long long>(line); },
+                       callbackErrors, options);
+            std::vector<size_t> parsed;
+            for (size_t line : b.valueLines)
+                if (line % 97 != 0)
+                    parsed.push_back(line);
+            check(seen == parsed && matching, "callback in input order with line numbers");
+            check(callbackErrors.size() == errors.size(), "callback reports the same errors");
+        }
+
+    // edge cases of the input itself
+    std::vector<line_error> errors;
+    check(parseLines("", errors).empty() && errors.empty(), "empty input");
+    check(parseLines("\n\n  \n", errors).empty() && errors.empty(), "only blank lines");
+    check(parseLines("1\n2\n", errors).size() == 2 && errors.empty(), "newline at the end");
+    std::vector<json> two = parseLines("[1] [2]\n3", errors);
+    check(two.size() == 2 && two[0].isNull() && errors.size() == 1 && errors[0].line == 1, "two values on one line");
+
+    // maxDepth applies to every line
+    line_options shallow;
+    shallow.maxDepth = 2;
+    std::vector<line_error> depthErrors;
+    std::vector<json> nested = parseLines("[[1]]\n[[[1]]]\n[2]", depthErrors, shallow);
+    check(nested.size() == 3 && nested[1].isNull() && depthErrors.size() == 1 && depthErrors[0].line == 2, "line deeper than maxDepth");
+    return report();
+}
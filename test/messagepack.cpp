@@ -0,0 +1,122 @@
+#include "../include/json.h"
+#include "check.h"
+#include <string>
+
+using namespace badge881::json;
+
+namespace
+{
+    std::string bytes(const char *hex)
+    {
+        std::string out;
+        for (; hex[0] && hex[1]; hex += 2)
+            out += char(std::stoi(std::string(hex, 2), nullptr, 16));
+        return out;
+    }
+
+    // the text parsed, encoded and decoded again equals the parsed value
+    // and keeps integers apart from doubles
+    void roundTrip(const std::string &text, size_t size, const char *what)
+    {
+        json value = parse(text);
+        std::string encoded = encode(value, binary_format::messagePack);
+        json decoded = decode(encoded, binary_format::messagePack);
+        check(encoded.size() == size, what);
+        check(decoded == value && decoded.isInteger() == value.isInteger() && print(decoded) == print(value), what);
+    }
+
+    bool throws(const std::string &input, const parse_options &options = parse_options())
+    {
+        try
+        {
+            decode(input, binary_format::messagePack, options);
+        }
+        catch (const json::read_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    // the smallest of fixint, 8, 16, 32 and 64 bits that holds the value
+    roundTrip("0", 1, "zero");
+    roundTrip("127", 1, "largest positive fixint");
+    roundTrip("128", 2, "smallest uint 8");
+    roundTrip("255", 2, "largest uint 8");
+    roundTrip("256", 3, "smallest uint 16");
+    roundTrip("65535", 3, "largest uint 16");
+    roundTrip("65536", 5, "smallest uint 32");
+    roundTrip("4294967295", 5, "largest uint 32");
+    roundTrip("4294967296", 9, "smallest uint 64");
+    roundTrip("18446744073709551615", 9, "2^64 - 1");
+    roundTrip("-1", 1, "minus one");
+    roundTrip("-32", 1, "smallest negative fixint");
+    roundTrip("-33", 2, "largest int 8");
+    roundTrip("-128", 2, "smallest int 8");
+    roundTrip("-129", 3, "largest int 16");
+    roundTrip("-32768", 3, "smallest int 16");
+    roundTrip("-32769", 5, "largest int 32");
+    roundTrip("-2147483648", 5, "smallest int 32");
+    roundTrip("-2147483649", 9, "largest int 64");
+    roundTrip("-9223372036854775808", 9, "-2^63");
+    // doubles a float holds exactly take five bytes, the others nine
+    roundTrip("1.5", 5, "double held by a float");
+    roundTrip("1.0", 5, "integral double stays a double");
+    roundTrip("-0.0", 5, "negative zero");
+    roundTrip("1.1", 9, "double that needs 64 bits");
+    roundTrip("1e300", 9, "double past the float range");
+    roundTrip("\"\"", 1, "empty string");
+    roundTrip("\"" + std::string(31, 'x') + "\"", 32, "largest fixstr");
+    roundTrip("\"" + std::string(32, 'x') + "\"", 34, "str 8");
+    roundTrip("\"" + std::string(256, 'x') + "\"", 259, "str 16");
+    roundTrip("[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]", 16, "largest fixarray");
+    roundTrip("[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]", 19, "array 16");
+    roundTrip("{\"a\": [1, {\"b\": [], \"c\": {}}, \"\"], \"d\": null, \"e\": [true, false]}", 21, "nested containers");
+    check(encode(parse("{\"a\": 1}"), binary_format::messagePack) == bytes("81a16101"), "fixmap head");
+
+    // vectors from the format specification
+    check(decode(bytes("ccff"), binary_format::messagePack) == json(255), "uint 8");
+    check(decode(bytes("cfffffffffffffffff"), binary_format::messagePack) == json(18446744073709551615ULL), "uint 64");
+    check(decode(bytes("d080"), binary_format::messagePack) == json(-128), "int 8");
+    check(decode(bytes("d38000000000000000"), binary_format::messagePack) == json(-9223372036854775807LL - 1), "int 64");
+    check(decode(bytes("ca3fc00000"), binary_format::messagePack).get<double>() == 1.5, "float 32");
+    check(decode(bytes("cb3ff199999999999a"), binary_format::messagePack).get<double>() == 1.1, "float 64");
+    check(decode(bytes("d903616263"), binary_format::messagePack) == json("abc"), "str 8");
+    check(decode(bytes("da0003616263"), binary_format::messagePack) == json("abc"), "str 16");
+    check(decode(bytes("db00000003616263"), binary_format::messagePack) == json("abc"), "str 32");
+    check(print(decode(bytes("dc00020102"), binary_format::messagePack)) == "[1, 2]", "array 16");
+    check(print(decode(bytes("dd0000000101"), binary_format::messagePack)) == "[1]", "array 32");
+    check(print(decode(bytes("de0001a16101"), binary_format::messagePack)) == "{\"a\": 1}", "map 16");
+    check(print(decode(bytes("93c0c3c2"), binary_format::messagePack)) == "[null, true, false]", "nil and booleans");
+
+    // what json has no type for, and malformed items
+    check(throws(bytes("c40101")), "bin 8");
+    check(throws(bytes("c7010100")), "ext 8");
+    check(throws(bytes("d40100")), "fixext 1");
+    check(throws(bytes("c1")), "never used byte");
+    check(throws(bytes("81c0c0")), "nil key");
+    check(throws(bytes("810101")), "integer key");
+    check(throws(bytes("a2c328")), "invalid utf-8");
+    check(throws(bytes("0000")), "anything after the value");
+
+    // truncated input : every prefix of a document throws
+    std::string whole = encode(parse("{\"a\": [1, 2.5, \"xyz\", {\"b\": null}], \"long\": \"0123456789012345678901234567890123\", \"n\": -100000, \"u\": 4000000000}"), binary_format::messagePack);
+    bool everyPrefix = true;
+    for (size_t size = 0; size < whole.size(); ++size)
+        everyPrefix = everyPrefix && throws(whole.substr(0, size));
+    check(everyPrefix, "truncated input");
+
+    // the depth limit of parse_options
+    std::string deep = std::string(1024, '\x91') + '\x00';
+    check(!throws(deep), "nesting at the limit");
+    check(throws('\x91' + deep), "nesting past the limit");
+    check(throws(std::string(1025, '\x81') + "\xa1" "a" + '\x00'), "objects nested past the limit");
+    parse_options raised;
+    raised.maxDepth = 100000;
+    std::string deeper = std::string(50000, '\x91') + '\x00';
+    check(!throws(deeper, raised) && encode(decode(deeper, binary_format::messagePack, raised), binary_format::messagePack) == deeper, "raised limit");
+    return report();
+}
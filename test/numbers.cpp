@@ -0,0 +1,74 @@
+#include "../include/json.h"
+#include "check.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+using namespace badge881::json;
+
+namespace
+{
+    // the same text through the tree parser, the push parser fed one
+    // character at a time and the token reader
+    json throughEveryParser(const std::string &text)
+    {
+        json tree = parse(text);
+        push_parser pushed;
+        for (char c : text)
+            pushed.feed(&c, 1);
+        pushed.finish();
+        check(pushed.result() == tree, "push parser agrees with parse");
+        token_reader reader(text);
+        check(reader.readNumber() == tree, "token reader agrees with parse");
+        return tree;
+    }
+
+    bool holds(const std::string &text, double expected)
+    {
+        json value = throughEveryParser(text);
+        double read = value.get<double>();
+        return value.isNumber() && read == expected && std::signbit(read) == std::signbit(expected);
+    }
+}
+
+int main()
+{
+    // past the range of a double : infinity or zero with the sign kept
+    check(holds("1e309", HUGE_VAL), "overflow");
+    check(holds("-1e400", -HUGE_VAL), "negative overflow");
+    check(holds("1.7976931348623159e308", HUGE_VAL), "just past the largest double");
+    check(holds("1e99999999999999999999999", HUGE_VAL), "exponent past 64 bits");
+    check(holds(std::string(400, '9'), HUGE_VAL), "400 digits");
+    check(holds("1e-400", 0.0), "underflow");
+    check(holds("-1e-400", -0.0), "negative underflow");
+    check(holds("0.0000001e-320", 0.0), "underflow with leading zeros");
+    check(holds("1000e-327", 0.0), "underflow with trailing digits");
+    // the edges that still fit
+    check(holds("1.7976931348623157e308", 1.7976931348623157e308), "largest double");
+    check(holds("4.9e-324", 4.9e-324), "smallest denormal");
+    check(holds("-0", -0.0), "negative zero");
+    // integers stay exact up to 64 bits
+    json above = parse("9007199254740993");
+    check(above.isInteger() && above.get<long long>() == 9007199254740993LL, "integer past 2^53");
+    check(parse("-9223372036854775808").get<long long>() == INT64_MIN, "smallest int64");
+    check(parse("18446744073709551615").get<unsigned long long>() == UINT64_MAX, "largest uint64");
+    check(!parse("18446744073709551616").isInteger(), "past uint64 read as a double");
+    // inside containers and query filters
+    json list = parse("[1e400, -1e-400, 2]");
+    check(list[0].get<double>() == HUGE_VAL && std::signbit(list[1].get<double>()), "numbers in a collection");
+    query huge("$[?(@ < 1e400)]");
+    check(huge.select(parse("[1, 2]")).size() == 2, "filter literal past the range");
+    query far("$[99999999999999999999]");
+    check(far.select(parse("[1, 2]")).empty(), "index past 64 bits");
+    bool rejected = false;
+    try
+    {
+        parse("1e");
+    }
+    catch (const json::read_error &)
+    {
+        rejected = true;
+    }
+    check(rejected, "exponent without digits");
+    return report();
+}
@@ -0,0 +1,133 @@
+#include "../include/json.h"
+#include "check.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace badge881::json;
+
+namespace
+{
+    // strings with every kind of escape, a surrogate pair, multibyte text,
+    // numbers of each kind and the three literals, so that cuts land inside
+    // each token
+    const std::string document = R"( {"plain": "text", "escapes": "a\"b\\c\/d\b\f\n\r\t", "unicode": "\u00e9\u4e2d\ud83d\ude00",
+        "raw": "é中😀", "numbers": [0, -1, 123456789, -9223372036854775808, 18446744073709551615, 18446744073709551616,
+        1.5, -0.25e-3, 6.02E+23, 1e400], "literals": [true, false, null], "nested": {"a": [{}, [], [[{"b": ""}]]]},
+        "": 7, "last": 42} )";
+
+    // feeds the pieces of the document and takes it, feed reports it
+    // complete once the closing brace was in a piece
+    json feedPieces(const std::vector<std::string> &pieces)
+    {
+        push_parser parser;
+        size_t fed = 0;
+        for (const std::string &piece : pieces)
+        {
+            fed += piece.size();
+            check(parser.feed(piece) == (fed > document.rfind('}')), "feed reports completion");
+        }
+        parser.finish();
+        return parser.result();
+    }
+
+    std::vector<std::string> cut(const std::string &text, std::mt19937 &random, size_t longest)
+    {
+        std::vector<std::string> pieces;
+        for (size_t at = 0; at < text.size();)
+        {
+            size_t size = std::uniform_int_distribution<size_t>(1, longest)(random);
+            pieces.push_back(text.substr(at, size));
+            at += size;
+        }
+        return pieces;
+    }
+
+    // counts containers, a handler that builds nothing
+    struct depth_counter : sax_handler
+    {
+        size_t opened = 0;
+        void onStartArray() override { ++opened; }
+    };
+
+    bool rejected(push_parser &parser, const std::string &text)
+    {
+        try
+        {
+            parser.feed(text);
+            parser.finish();
+        }
+        catch (const json::read_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    json expected = parse(document);
+    check(expected["unicode"] == expected["raw"], "\\u escapes and surrogate pairs decoded");
+
+    std::vector<std::string> bytes;
+    for (char c : document)
+        bytes.emplace_back(1, c);
+    check(feedPieces(bytes) == expected, "one byte at a time");
+    check(feedPieces({document}) == expected, "all at once");
+
+    std::mt19937 random(881);
+    bool everySplit = true;
+    for (int round = 0; round < 500; ++round)
+        everySplit = everySplit && feedPieces(cut(document, random, round % 2 ? 4 : 32)) == expected;
+    check(everySplit, "random splits");
+
+    // cut at each position in turn, through every token
+    bool everyPosition = true;
+    for (size_t at = 1; at < document.size(); ++at)
+        everyPosition = everyPosition && feedPieces({document.substr(0, at), document.substr(at)}) == expected;
+    check(everyPosition, "two pieces cut anywhere");
+
+    // a number at the top level only ends with the input
+    push_parser number;
+    check(!number.feed("12") && !number.feed("34"), "number still open");
+    number.finish();
+    check(number.result() == json(1234), "number ended by finish");
+
+    // the parser is ready for the next document after result()
+    push_parser reused;
+    reused.feed("[1, ");
+    reused.feed("2]");
+    check(print(reused.result()) == "[1, 2]", "first document");
+    reused.feed("{\"a\"");
+    reused.feed(": \"b\"}");
+    check(print(reused.result()) == "{\"a\": \"b\"}", "second document");
+
+    push_parser split;
+    check(rejected(split, "[1] 2"), "anything after the document");
+    push_parser cutShort;
+    check(rejected(cutShort, "{\"a\": [1, 2"), "document cut short");
+
+    // maxDepth, for the tree and for a handler
+    std::string limit = std::string(1024, '[') + std::string(1024, ']');
+    std::string past = '[' + limit + ']';
+    push_parser atLimit, pastLimit;
+    check(!rejected(atLimit, limit) && rejected(pastLimit, past), "default limit for the tree");
+    depth_counter counter;
+    push_parser handlerAtLimit(counter), handlerPastLimit(counter);
+    check(!rejected(handlerAtLimit, limit) && rejected(handlerPastLimit, past), "default limit for a handler");
+    parse_options raised;
+    raised.maxDepth = 5000;
+    std::string deep = std::string(5000, '[') + std::string(5000, ']');
+    push_parser treeRaised(raised);
+    check(!rejected(treeRaised, deep), "raised limit for the tree");
+    depth_counter raisedCounter;
+    push_parser handlerRaised(raisedCounter, raised);
+    check(!rejected(handlerRaised, deep) && raisedCounter.opened == 5000, "raised limit for a handler");
+    parse_options lowered;
+    lowered.maxDepth = 3;
+    depth_counter loweredCounter;
+    push_parser handlerLowered(loweredCounter, lowered);
+    check(rejected(handlerLowered, "[[[[]]]]"), "lowered limit for a handler");
+    return report();
+}
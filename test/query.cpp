@@ -0,0 +1,94 @@
+#include "../include/json.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+using namespace badge881::json;
+
+namespace
+{
+    const char *document = R"({
+        "a/b": 1, "m~n": 2, "~1": 3, "": 4,
+        "store": {
+            "book": [
+                {"title": "one", "price": 8, "tags": ["x"]},
+                {"title": "two", "price": 12.5},
+                {"title": "three", "price": 5, "tags": []},
+                {"title": "four", "price": 20, "tags": ["y", "z"]}
+            ],
+            "bicycle": {"price": 19.95}
+        }
+    })";
+
+    // the matches printed in order, the same over the tree and the text
+    std::string run(const char *text)
+    {
+        query q(text);
+        json tree = parse(document);
+        std::string fromTree, fromText;
+        for (const json *match : q.select(tree))
+            fromTree += print(*match) + ";";
+        for (const json &match : q.selectText(document))
+            fromText += print(match) + ";";
+        const json *first = q.first(tree);
+        check(fromTree == fromText, text);
+        check(first ? fromTree.find(print(*first) + ";") == 0 : fromTree.empty(), text);
+        return fromTree;
+    }
+
+    bool tooDeep(const query &q, const std::string &text, const parse_options &options = parse_options())
+    {
+        try
+        {
+            q.selectText(text, options);
+        }
+        catch (const json::read_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    // json pointers, ~1 stands for / and ~0 for ~
+    check(run("/a~1b") == "1;", "~1 in a pointer");
+    check(run("/m~0n") == "2;", "~0 in a pointer");
+    check(run("/~01") == "3;", "~01 is ~1 and not /");
+    check(run("/") == "4;", "empty member name");
+    check(run("/store/book/1/title") == "\"two\";", "array index in a pointer");
+    check(run("/store/book/4").empty(), "index past the end");
+    check(run("/store/book/-1").empty(), "negative index in a pointer");
+
+    // json paths
+    check(run("$.store.book[0].title") == "\"one\";", "member and index");
+    check(run("$.store.book[-1].title") == "\"four\";", "index from the end");
+    check(run("$.store.book[0,2].price") == "8;5;", "union of indices");
+    check(run("$.store.book[1:3].title") == "\"two\";\"three\";", "slice");
+    check(run("$.store.book[::-2].title") == "\"four\";\"two\";", "slice backwards");
+    check(run("$.store.book[*].title") == "\"one\";\"two\";\"three\";\"four\";", "wildcard");
+    check(run("$.store.*.price") == "19.95;", "wildcard over members");
+    check(run("$..price") == "8;12.5;5;20;19.95;", "recursive descent in document order");
+    check(run("$['a/b']") == "1;", "quoted name");
+    check(run("$.store.book[?(@.price < 10)].title") == "\"one\";\"three\";", "filter on a number");
+    check(run("$.store.book[?(@.price >= 12.5 && @.title != 'four')].title") == "\"two\";", "filter with and");
+    check(run("$.store.book[?(@.price < 6 || @.price > 19)].title") == "\"three\";\"four\";", "filter with or");
+    check(run("$.store.book[?(@.tags)].title") == "\"one\";\"three\";\"four\";", "filter on a member existing");
+    check(run("$.store.book[?(@.tags[0] == 'y')].title") == "\"four\";", "filter on a nested path");
+    check(run("$.nothing[*]").empty(), "no match");
+
+    // selectText keeps to maxDepth like every other reader of text
+    query all("$");
+    query everything("$..*");
+    std::string limit = std::string(1024, '[') + std::string(1024, ']');
+    std::string past = '[' + limit + ']';
+    check(!tooDeep(all, limit) && !tooDeep(everything, limit), "nesting at the limit");
+    check(tooDeep(all, past) && tooDeep(everything, past), "nesting past the limit");
+    check(tooDeep(all, "{\"a\": " + past + "}"), "nesting past the limit under a member");
+    parse_options raised;
+    raised.maxDepth = 2000;
+    check(!tooDeep(everything, past, raised), "raised limit");
+    check(all.selectText(past, raised).size() == 1 && everything.selectText(past, raised).size() == 1024, "matches under a raised limit");
+    return report();
+}
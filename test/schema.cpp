@@ -0,0 +1,79 @@
+#include "../include/json.h"
+#include "check.h"
+#include <string>
+
+using namespace badge881::json;
+
+namespace
+{
+    // the compiled tree check and the check over the text agree, and both
+    // give the expected answer
+    void expect(const schema &s, const std::string &text, bool valid, const char *what)
+    {
+        schema_error treeError, textError;
+        bool tree = s.validate(parse(text), treeError);
+        bool streamed = s.validateText(text, textError);
+        check(tree == valid, what);
+        check(streamed == valid, what);
+        check(valid || treeError.path == textError.path, what);
+    }
+
+    bool rejected(const char *text)
+    {
+        try
+        {
+            schema s(parse(text));
+        }
+        catch (const json::type_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    // $ref recursion, through a json pointer and through a plain name $id
+    for (const std::string reference : {"#/definitions/node", "#node"})
+    {
+        std::string text = R"({"definitions": {"node": {"$id": "#node", "type": "object", "required": ["value"],
+            "properties": {"value": {"type": "integer"}, "children": {"type": "array", "items": {"$ref": "@"}}}}},
+            "$ref": "@"})";
+        for (size_t at; (at = text.find('@')) != std::string::npos;)
+            text.replace(at, 1, reference);
+        schema tree(parse(text));
+        expect(tree, R"({"value": 1})", true, "leaf");
+        expect(tree, R"({"value": 1, "children": [{"value": 2, "children": [{"value": 3}]}, {"value": 4}]})", true, "nested nodes");
+        expect(tree, R"({"value": 1, "children": [{"value": 2, "children": [{"value": "3"}]}]})", false, "wrong type three levels down");
+        expect(tree, R"({"value": 1, "children": [{"children": []}]})", false, "missing member in a child");
+    }
+    schema anchored(parse(R"({"definitions": {"a": {"$id": "#foo", "minimum": 3}}, "$ref": "#foo"})"));
+    expect(anchored, "3", true, "anchor at its bound");
+    expect(anchored, "2", false, "anchor below its bound");
+    check(rejected(R"({"$ref": "#missing"})"), "unknown anchor");
+    check(rejected(R"({"definitions": {"a": {"$id": "#x"}, "b": {"$id": "#x"}}})"), "anchor declared twice");
+    check(rejected(R"({"enum": [{"$id": "#e"}], "$ref": "#e"})"), "$id inside enum is a value");
+
+    // if, then and else
+    schema conditional(parse(R"({"if": {"type": "integer"}, "then": {"minimum": 10}, "else": {"type": "string"}})"));
+    expect(conditional, "12", true, "then holds");
+    expect(conditional, "5", false, "then fails");
+    expect(conditional, "\"text\"", true, "else holds");
+    expect(conditional, "1.5", false, "else fails");
+    expect(conditional, "[1]", false, "else fails on a collection");
+    schema onlyThen(parse(R"({"if": {"required": ["a"]}, "then": {"required": ["b"]}})"));
+    expect(onlyThen, R"({"a": 1, "b": 2})", true, "if and then");
+    expect(onlyThen, R"({"a": 1})", false, "if without then");
+    expect(onlyThen, R"({"c": 1})", true, "if fails without else");
+
+    // uniqueItems compares numbers by value, 1 and 1.0 are the same
+    schema unique(parse(R"({"uniqueItems": true})"));
+    expect(unique, "[1, 1.0]", false, "1 and 1.0");
+    expect(unique, "[1, 1.5]", true, "1 and 1.5");
+    expect(unique, R"([{"a": [1, 2]}, {"a": [1.0, 2]}])", false, "1 and 1.0 inside objects");
+    expect(unique, R"([{"a": 1, "b": 2}, {"b": 2, "a": 1}])", false, "member order does not count");
+    expect(unique, R"(["1", 1, true, null, [], {}])", true, "different types");
+    expect(unique, "[9007199254740993, 9007199254740992]", true, "integers past 2^53");
+    return report();
+}
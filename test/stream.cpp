@@ -0,0 +1,58 @@
+#include "../include/json.h"
+#include "check.h"
+#include <sstream>
+
+using namespace badge881::json;
+
+namespace
+{
+    // hands the text over a few characters at a time and cannot seek, like
+    // a pipe or a socket
+    class pipe_buffer : public std::streambuf
+    {
+        std::string text;
+        size_t position = 0;
+        size_t piece;
+        char window[8];
+
+    protected:
+        int_type underflow() override
+        {
+            if (gptr() != egptr())
+                return traits_type::to_int_type(*gptr());
+            if (position == text.size())
+                return traits_type::eof();
+            size_t size = std::min(piece, text.size() - position);
+            text.copy(window, size, position);
+            position += size;
+            setg(window, window, window + size);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    public:
+        pipe_buffer(std::string t, size_t p) : text(std::move(t)), piece(p) {}
+    };
+}
+
+int main()
+{
+    const std::string text = " {\"a\": [1, \"x\"]} 42 \"two words\" [true] 7";
+    for (size_t piece : {1, 3, 8})
+    {
+        pipe_buffer buffer(text, piece);
+        std::istream is(&buffer);
+        json a, b, c, d, e;
+        is >> a >> b >> c >> d >> e;
+        check(print(a) == "{\"a\": [1, \"x\"]}", "object before a number");
+        check(b == json(42), "number ended by a space");
+        check(c == json(std::string("two words")), "string");
+        check(print(d) == "[true]", "collection");
+        check(e == json(7), "number ended by the end of the stream");
+        check(is.eof(), "end of the stream reached");
+    }
+    std::istringstream seekable("[1] [2]");
+    json first, second;
+    seekable >> first >> second;
+    check(print(first) == "[1]" && print(second) == "[2]", "two values from a string stream");
+    return report();
+}